@@ -0,0 +1,130 @@
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "BatchRunner.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+BatchRunner::BatchRunner(Loader loader, Engine engine, size_t heapLimit, unsigned threads)
+    : loader(loader), engine(engine), heapLimit(heapLimit), threads(threads) {
+}
+
+vector<BatchJob> BatchRunner::readList(const string &filename) {
+    ifstream list(filename.c_str());
+    if(!list) {
+        throw FileNotFoundException();
+    }
+    vector<BatchJob> jobs;
+    string line;
+    while(getline(list, line)) {
+        istringstream fields(line);
+        BatchJob job;
+        if(fields >> job.source) {
+            fields >> job.input >> job.output;
+            jobs.push_back(job);
+        }
+    }
+    return jobs;
+}
+
+// The first job that needs a source loads it, the others wait for it
+const Program &BatchRunner::program(const string &source) {
+    shared_ptr<Loaded> loaded;
+    {
+        lock_guard<mutex> guard(programsLock);
+        shared_ptr<Loaded> &entry = programs[source];
+        if(!entry) {
+            entry.reset(new Loaded);
+        }
+        loaded = entry;
+    }
+    call_once(loaded->once, [&]() {
+        try {
+            loaded->program = loader(source);
+        } catch(...) {
+            loaded->error = current_exception();
+        }
+    });
+    if(loaded->error) {
+        rethrow_exception(loaded->error);
+    }
+    return loaded->program;
+}
+
+void BatchRunner::runJob(const BatchJob &job, Outcome &outcome) {
+    int inputFd = -1, outputFd = -1;
+    try {
+        if(!job.input.empty() && (inputFd = open(job.input.c_str(), O_RDONLY)) < 0) {
+            throw FileNotFoundException();
+        }
+        if(!job.output.empty() && (outputFd = open(job.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+            throw OutputException();
+        }
+        BufferSource noInput("");
+        FdSource fileInput(inputFd);
+        BufferSink collected;
+        FdSink fileOutput(outputFd);
+
+        Interpreter interpreter(program(job.source), ValueStack::DEFAULT_CAPACITY, heapLimit);
+        interpreter.redirect(inputFd >= 0 ? (Source &)fileInput : noInput,
+                             outputFd >= 0 ? (Sink &)fileOutput : collected);
+        try {
+            interpreter.interpret(engine);
+        } catch(exception &e) {
+            outcome.error = e.what();
+        }
+        outcome.instructions = interpreter.instructionCount();
+        interpreter.redirect(noInput, collected); // Flushes before the files are closed
+        outcome.output = collected.contents();
+    } catch(exception &e) {
+        outcome.error = e.what();
+    }
+    if(inputFd >= 0) {
+        close(inputFd);
+    }
+    if(outputFd >= 0) {
+        close(outputFd);
+    }
+}
+
+// Returns whether all jobs succeeded
+bool BatchRunner::run(const vector<BatchJob> &jobs, ostream &out, ostream &log) {
+    vector<Outcome> outcomes(jobs.size());
+    ThreadPool pool(threads);
+    for(unsigned k = 0; k < jobs.size(); k++) {
+        outcomes[k].instructions = 0;
+        pool.submit([this, &jobs, &outcomes, k]() {
+            runJob(jobs[k], outcomes[k]);
+        });
+    }
+
+    auto start = chrono::steady_clock::now();
+    pool.run();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    unsigned failed = 0;
+    unsigned long long instructions = 0;
+    for(unsigned k = 0; k < jobs.size(); k++) {
+        out << outcomes[k].output;
+        if(!outcomes[k].error.empty()) {
+            log << "Job " << k + 1 << " (" << jobs[k].source << "): " << outcomes[k].error << endl;
+            failed++;
+        }
+        instructions += outcomes[k].instructions;
+    }
+    out.flush();
+
+    double seconds = elapsed.count();
+    log << jobs.size() << " jobs, " << failed << " failed, " << programs.size() << " programs on "
+        << pool.threadCount() << " threads in " << seconds << " s ("
+        << (seconds > 0 ? jobs.size() / seconds : 0) << " jobs/s";
+    if(instructions > 0) { // Native code doesn't count its instructions
+        log << ", " << (seconds > 0 ? instructions / seconds : 0) << " instructions/s";
+    }
+    log << ")" << endl;
+    return failed == 0;
+}
@@ -0,0 +1,59 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <ostream>
+
+#include "Interpreter.h"
+#include "Exceptions.h"
+
+// One program run of a batch. Without an input file the program reads
+// empty input; without an output file its output is collected and printed
+// after the batch, in the order of the list.
+struct BatchJob {
+    std::string source, input, output;
+};
+
+// Runs a list of independent programs on a ThreadPool. Every job has its
+// own Interpreter with its own input and output, and a source that is used
+// by several jobs is loaded only once.
+class BatchRunner {
+    public:
+        typedef std::function<Program(const std::string &)> Loader;
+
+        BatchRunner(Loader, Engine, size_t, unsigned);
+        bool run(const std::vector<BatchJob> &, std::ostream &, std::ostream &);
+
+        // One job per line: source [input [output]]
+        static std::vector<BatchJob> readList(const std::string &);
+
+    private:
+        struct Loaded {
+            std::once_flag once;
+            Program program;
+            std::exception_ptr error;
+        };
+
+        struct Outcome {
+            std::string output;
+            std::string error; // Empty if the job succeeded
+            unsigned long long instructions;
+        };
+
+        Loader loader;
+        Engine engine;
+        size_t heapLimit;
+        unsigned threads;
+        std::mutex programsLock;
+        std::map<std::string, std::shared_ptr<Loaded> > programs;
+
+        const Program &program(const std::string &);
+        void runJob(const BatchJob &, Outcome &);
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <climits>
+
+#include "BigInt.h"
+
+using namespace std;
+
+BigInt::BigInt() {
+    negative = false;
+}
+
+BigInt::BigInt(long value) {
+    negative = value < 0;
+    // Negating in unsigned arithmetic also works for LONG_MIN
+    unsigned long magnitude = (negative ? -(unsigned long)value : (unsigned long)value);
+    while(magnitude != 0) {
+        limbs.push_back((uint32_t)magnitude);
+        magnitude >>= 32;
+    }
+}
+
+BigInt BigInt::parse(const string &text) {
+    BigInt result;
+    unsigned k = 0;
+    bool negative = false;
+
+    if(k < text.size() && (text[k] == '-' || text[k] == '+')) {
+        negative = (text[k++] == '-');
+    }
+    if(k == text.size()) {
+        throw InvalidNumberException();
+    }
+    for(; k < text.size(); k++) {
+        if(text[k] < '0' || text[k] > '9') {
+            throw InvalidNumberException();
+        }
+        multiplyAddSmall(result.limbs, 10, text[k] - '0');
+    }
+    result.negative = negative;
+    result.trim();
+    return result;
+}
+
+BigInt BigInt::fromBits(const vector<bool> &bits, bool negative) {
+    BigInt result;
+    for(unsigned k = 0; k < bits.size(); k++) {
+        multiplyAddSmall(result.limbs, 2, bits[k] ? 1 : 0);
+    }
+    result.negative = negative;
+    result.trim();
+    return result;
+}
+
+bool BigInt::isZero() const {
+    return limbs.empty();
+}
+
+bool BigInt::isNegative() const {
+    return negative;
+}
+
+bool BigInt::fitsLong() const {
+    if(limbs.size() > 2) {
+        return false;
+    }
+    unsigned long magnitude = 0;
+    for(int k = limbs.size() - 1; k >= 0; k--) {
+        magnitude = (magnitude << 32) | limbs[k];
+    }
+    return magnitude <= (negative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX);
+}
+
+long BigInt::toLong() const {
+    unsigned long magnitude = 0;
+    for(int k = limbs.size() - 1; k >= 0; k--) {
+        magnitude = (magnitude << 32) | limbs[k];
+    }
+    return (long)(negative ? -magnitude : magnitude);
+}
+
+string BigInt::toString() const {
+    if(isZero()) {
+        return "0";
+    }
+    Magnitude rest = limbs;
+    string digits;
+    while(!rest.empty()) {
+        // Nine decimal digits at a time
+        uint32_t chunk = divideSmall(rest, 1000000000);
+        for(int k = 0; k < 9; k++) {
+            digits.push_back('0' + chunk % 10);
+            chunk /= 10;
+            if(rest.empty() && chunk == 0) {
+                break;
+            }
+        }
+    }
+    if(negative) {
+        digits.push_back('-');
+    }
+    reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+BigInt operator+(const BigInt &a, const BigInt &b) {
+    BigInt result;
+    if(a.negative == b.negative) {
+        result.limbs = BigInt::addMagnitude(a.limbs, b.limbs);
+        result.negative = a.negative;
+    } else if(BigInt::compareMagnitude(a.limbs, b.limbs) >= 0) {
+        result.limbs = BigInt::subtractMagnitude(a.limbs, b.limbs);
+        result.negative = a.negative;
+    } else {
+        result.limbs = BigInt::subtractMagnitude(b.limbs, a.limbs);
+        result.negative = b.negative;
+    }
+    result.trim();
+    return result;
+}
+
+BigInt operator-(const BigInt &a, const BigInt &b) {
+    BigInt negated = b;
+    negated.negative = !b.negative;
+    negated.trim();
+    return a + negated;
+}
+
+BigInt operator*(const BigInt &a, const BigInt &b) {
+    BigInt result;
+    if(a.isZero() || b.isZero()) {
+        return result;
+    }
+    result.limbs.assign(a.limbs.size() + b.limbs.size(), 0);
+    for(unsigned i = 0; i < a.limbs.size(); i++) {
+        uint64_t carry = 0;
+        for(unsigned j = 0; j < b.limbs.size(); j++) {
+            uint64_t product = (uint64_t)a.limbs[i] * b.limbs[j] + result.limbs[i + j] + carry;
+            result.limbs[i + j] = (uint32_t)product;
+            carry = product >> 32;
+        }
+        result.limbs[i + b.limbs.size()] = (uint32_t)carry;
+    }
+    result.negative = a.negative != b.negative;
+    result.trim();
+    return result;
+}
+
+// Truncating division: the quotient is rounded towards zero and the
+// remainder has the sign of the dividend.
+void BigInt::divide(const BigInt &a, const BigInt &b, BigInt &quotient, BigInt &remainder) {
+    if(b.isZero()) {
+        throw DivisionByZeroException();
+    }
+    quotient = BigInt();
+    remainder = BigInt();
+
+    if(b.limbs.size() == 1) {
+        quotient.limbs = a.limbs;
+        uint32_t rest = divideSmall(quotient.limbs, b.limbs[0]);
+        if(rest != 0) {
+            remainder.limbs.push_back(rest);
+        }
+    } else {
+        // Binary long division, one bit of the dividend at a time
+        quotient.limbs.assign(a.limbs.size(), 0);
+        for(int k = a.limbs.size() * 32 - 1; k >= 0; k--) {
+            multiplyAddSmall(remainder.limbs, 2, (a.limbs[k / 32] >> (k % 32)) & 1);
+            if(compareMagnitude(remainder.limbs, b.limbs) >= 0) {
+                remainder.limbs = subtractMagnitude(remainder.limbs, b.limbs);
+                while(!remainder.limbs.empty() && remainder.limbs.back() == 0) {
+                    remainder.limbs.pop_back();
+                }
+                quotient.limbs[k / 32] |= 1U << (k % 32);
+            }
+        }
+    }
+    quotient.negative = a.negative != b.negative;
+    remainder.negative = a.negative;
+    quotient.trim();
+    remainder.trim();
+}
+
+void BigInt::trim() {
+    while(!limbs.empty() && limbs.back() == 0) {
+        limbs.pop_back();
+    }
+    if(limbs.empty()) {
+        negative = false;
+    }
+}
+
+int BigInt::compareMagnitude(const Magnitude &a, const Magnitude &b) {
+    if(a.size() != b.size()) {
+        return (a.size() < b.size() ? -1 : 1);
+    }
+    for(int k = a.size() - 1; k >= 0; k--) {
+        if(a[k] != b[k]) {
+            return (a[k] < b[k] ? -1 : 1);
+        }
+    }
+    return 0;
+}
+
+BigInt::Magnitude BigInt::addMagnitude(const Magnitude &a, const Magnitude &b) {
+    const Magnitude &longer = (a.size() >= b.size() ? a : b);
+    const Magnitude &shorter = (a.size() >= b.size() ? b : a);
+    Magnitude sum(longer.size() + 1, 0);
+    uint64_t carry = 0;
+
+    for(unsigned k = 0; k < longer.size(); k++) {
+        carry += (uint64_t)longer[k] + (k < shorter.size() ? shorter[k] : 0);
+        sum[k] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    sum[longer.size()] = (uint32_t)carry;
+    return sum;
+}
+
+// Requires |a| >= |b|
+BigInt::Magnitude BigInt::subtractMagnitude(const Magnitude &a, const Magnitude &b) {
+    Magnitude difference(a.size(), 0);
+    int64_t borrow = 0;
+
+    for(unsigned k = 0; k < a.size(); k++) {
+        int64_t value = (int64_t)a[k] - (k < b.size() ? b[k] : 0) - borrow;
+        borrow = (value < 0 ? 1 : 0);
+        difference[k] = (uint32_t)(value + (borrow << 32));
+    }
+    return difference;
+}
+
+// Divides in place and returns the remainder
+uint32_t BigInt::divideSmall(Magnitude &limbs, uint32_t divisor) {
+    uint64_t rest = 0;
+    for(int k = limbs.size() - 1; k >= 0; k--) {
+        uint64_t current = (rest << 32) | limbs[k];
+        limbs[k] = (uint32_t)(current / divisor);
+        rest = current % divisor;
+    }
+    while(!limbs.empty() && limbs.back() == 0) {
+        limbs.pop_back();
+    }
+    return (uint32_t)rest;
+}
+
+// limbs = limbs * factor + addend
+void BigInt::multiplyAddSmall(Magnitude &limbs, uint32_t factor, uint32_t addend) {
+    uint64_t carry = addend;
+    for(unsigned k = 0; k < limbs.size(); k++) {
+        carry += (uint64_t)limbs[k] * factor;
+        limbs[k] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if(carry != 0) {
+        limbs.push_back((uint32_t)carry);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef BIGINT_H
+#define BIGINT_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "Exceptions.h"
+
+// Arbitrary-precision integer, stored as sign and magnitude with 32-bit
+// limbs, least significant first. Zero has no limbs and is never negative.
+// Division truncates towards zero, like the built-in integer division.
+class BigInt {
+    public:
+        BigInt();
+        BigInt(long);
+
+        static BigInt parse(const std::string &);
+        // Builds a number from binary digits, most significant first
+        static BigInt fromBits(const std::vector<bool> &, bool);
+
+        bool isZero() const;
+        bool isNegative() const;
+        bool fitsLong() const;
+        long toLong() const; // Only valid when fitsLong()
+        std::string toString() const;
+
+        friend BigInt operator+(const BigInt &, const BigInt &);
+        friend BigInt operator-(const BigInt &, const BigInt &);
+        friend BigInt operator*(const BigInt &, const BigInt &);
+        static void divide(const BigInt &, const BigInt &, BigInt &, BigInt &);
+
+    private:
+        typedef std::vector<uint32_t> Magnitude;
+
+        bool negative;
+        Magnitude limbs;
+
+        void trim();
+        static int compareMagnitude(const Magnitude &, const Magnitude &);
+        static Magnitude addMagnitude(const Magnitude &, const Magnitude &);
+        static Magnitude subtractMagnitude(const Magnitude &, const Magnitude &);
+        static uint32_t divideSmall(Magnitude &, uint32_t);
+        static void multiplyAddSmall(Magnitude &, uint32_t, uint32_t);
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "BytecodeCache.h"
+
+using namespace std;
+
+static const char MAGIC[4] = {'W', 'S', 'B', 'C'};
+
+static atomic<unsigned> saves(0); // Keeps temporary names apart within a process
+
+BytecodeCache::BytecodeCache(const string &sourceFilename) {
+    path = sourceFilename + "c";
+}
+
+// FNV-1a, which is plenty to notice that a source has changed
+uint64_t BytecodeCache::hash(const char *data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t k = 0; k < size; k++) {
+        hash = (hash ^ (unsigned char)data[k]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Maps the cache file and builds the program straight from its records.
+// Returns false if there is no usable cache file.
+bool BytecodeCache::load(uint64_t sourceHash, bool optimized, Program &program) const {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    void *memory = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED) {
+        return false;
+    }
+
+    const char *data = (const char *)memory;
+    const Header *header = (const Header *)data;
+    size_t recordsEnd = sizeof(Header) + (size_t)header->instructions * sizeof(Record);
+    bool valid = memcmp(header->magic, MAGIC, 4) == 0 && header->version == VERSION &&
+                 header->sourceHash == sourceHash && ((header->flags & OPTIMIZED) != 0) == optimized &&
+                 recordsEnd + header->literalBytes == size;
+
+    if(valid) {
+        // Big literals are rare, so they're parsed before the records need them
+        vector<Cell> literals;
+        const char *literal = data + recordsEnd, *end = data + size;
+        for(uint32_t k = 0; k < header->literals && valid; k++) {
+            uint32_t length;
+            if(end - literal < 4) {
+                valid = false;
+                break;
+            }
+            memcpy(&length, literal, 4);
+            literal += 4;
+            if((size_t)(end - literal) < length) {
+                valid = false;
+                break;
+            }
+            try {
+                literals.push_back(Cell::parse(string(literal, length)));
+            } catch(InvalidNumberException &e) {
+                valid = false;
+            }
+            literal += length;
+        }
+
+        const Record *records = (const Record *)(data + sizeof(Header));
+        program.clear();
+        program.reserve(header->instructions);
+        for(uint32_t k = 0; k < header->instructions && valid; k++) {
+            const Record &record = records[k];
+            if(record.op > COPYHEAP || record.target > header->instructions ||
+               (record.bigArgument && (uint64_t)record.arg >= literals.size())) {
+                valid = false;
+                break;
+            }
+            program.push_back(Instruction((Opcode)record.op,
+                                          record.bigArgument ? literals[record.arg] : Cell(record.arg)));
+            program.back().target = record.target;
+        }
+    }
+    munmap(memory, size);
+    return valid;
+}
+
+// Best effort: a source in a read-only directory simply isn't cached. The
+// file is written under a temporary name first, so a concurrent run never
+// sees half of it. The name is unique to the process and the save, since
+// batch jobs on other threads may save the same source under another path.
+void BytecodeCache::save(uint64_t sourceHash, bool optimized, const Program &program) const {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.sourceHash = sourceHash;
+    header.flags = (optimized ? OPTIMIZED : 0);
+    header.instructions = program.size();
+
+    string contents((const char *)&header, sizeof(header)), literals;
+    for(unsigned k = 0; k < program.size(); k++) {
+        Record record;
+        memset(&record, 0, sizeof(record));
+        record.op = program[k].op;
+        record.target = program[k].target;
+        if(program[k].arg.isSmall()) {
+            record.arg = program[k].arg.small();
+        } else {
+            string digits = program[k].arg.toString();
+            uint32_t length = digits.size();
+            record.bigArgument = 1;
+            record.arg = header.literals++;
+            literals.append((const char *)&length, 4);
+            literals.append(digits);
+        }
+        contents.append((const char *)&record, sizeof(record));
+    }
+    header.literalBytes = literals.size();
+    memcpy(&contents[0], &header, sizeof(header));
+    contents.append(literals);
+
+    string temporary = path + "." + to_string(getpid()) + "." + to_string(saves++);
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if(fd < 0) {
+        return;
+    }
+    bool written = write(fd, contents.data(), contents.size()) == (ssize_t)contents.size();
+    close(fd);
+    if(!written || rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+    }
+}
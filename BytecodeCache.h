@@ -0,0 +1,54 @@
+#ifndef BYTECODECACHE_H
+#define BYTECODECACHE_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "Types.h"
+
+// Stores linked (and possibly optimized) programs next to their source,
+// as file.ws -> file.wsc, so later runs can skip parsing. A cache file is
+// only used when the version, the hash of the source and the optimization
+// setting all match; otherwise the program is decoded again and the cache
+// rewritten.
+//
+// Layout, in host byte order:
+//   Header       magic, version, source hash, flags, counts
+//   Record[n]    one fixed-size record per instruction
+//   Literals     numbers that don't fit in a record, as decimal strings
+class BytecodeCache {
+    public:
+        static const uint32_t VERSION = 3;
+
+        BytecodeCache(const std::string &);
+        bool load(uint64_t, bool, Program &) const;
+        void save(uint64_t, bool, const Program &) const;
+
+        static uint64_t hash(const char *, size_t);
+
+    private:
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint64_t sourceHash;
+            uint32_t flags;
+            uint32_t instructions;
+            uint32_t literals;
+            uint32_t literalBytes;
+        };
+
+        struct Record {
+            uint8_t op;
+            uint8_t bigArgument; // If set, arg indexes the literals
+            uint16_t reserved;
+            uint32_t target;
+            int64_t arg;
+        };
+
+        static const uint32_t OPTIMIZED = 1;
+
+        std::string path;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include <climits>
+#include <set>
+
+#include "CEmitter.h"
+
+using namespace std;
+
+// The generated C works on machine words, so big literals are rejected
+string CEmitter::literal(const Cell &cell) {
+    if(!cell.isSmall()) {
+        throw NumberTooLargeException();
+    }
+    long value = cell.small();
+    if(value == LONG_MIN) { // Can't be written as a negated literal
+        return "(-" + to_string(LONG_MAX) + "L - 1)";
+    }
+    return to_string(value) + "L";
+}
+
+string CEmitter::label(unsigned pc) {
+    return "L" + to_string(pc);
+}
+
+string CEmitter::emit(const Program &p) {
+    unsigned size = p.size();
+    set<unsigned> targets;
+    bool returns = false;
+
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(isBranch(p[pc].op)) {
+            targets.insert(p[pc].target);
+        }
+        if(p[pc].op == ENDSUB) {
+            returns = true;
+        }
+    }
+
+    string c;
+    c.append("/* Generated by whitespace --emit-c */\n");
+    c.append("#include \"WhitespaceRuntime.h\"\n\n");
+    c.append("int main(void) {\n");
+    c.append("    long a, b;\n");
+    c.append("    (void)a; (void)b;\n");
+
+    unsigned sites = 0; // Number of CALL instructions, each gets its own return label
+    for(unsigned pc = 0; pc < size; pc++) {
+        const Instruction &in = p[pc];
+        if(targets.count(pc)) {
+            c.append(label(pc) + ":\n");
+        }
+        // Labels are resolved to targets already, and may be longer than a word
+        string target = label(in.target), arg = (isBranch(in.op) || in.op == MARK ? "" : literal(in.arg));
+        c.append("    ");
+
+        switch(in.op) {
+            // Stack manipulations
+            case PUSH: c.append("ws_push(" + arg + ");"); break;
+            case DUP: c.append("ws_push(*ws_peek(0));"); break;
+            case COPY: c.append("ws_push(*ws_peek(" + arg + "));"); break;
+            case SWAP: c.append("a = ws_pop(); b = ws_pop(); ws_push(a); ws_push(b);"); break;
+            case DISCARD: c.append("(void)ws_pop();"); break;
+            case SLIDE: c.append("ws_slide(" + arg + ");"); break;
+
+            // Arithmetic
+            case ADD: c.append("a = ws_pop(); b = ws_pop(); ws_push(ws_add(b, a));"); break;
+            case SUB: c.append("a = ws_pop(); b = ws_pop(); ws_push(ws_sub(b, a));"); break;
+            case MUL: c.append("a = ws_pop(); b = ws_pop(); ws_push(ws_mul(b, a));"); break;
+            case DIV: c.append("a = ws_pop(); b = ws_pop(); ws_push(ws_divide(b, a, 0));"); break;
+            case MOD: c.append("a = ws_pop(); b = ws_pop(); ws_push(ws_divide(b, a, 1));"); break;
+
+            // Heap access
+            case STORE: c.append("a = ws_pop(); b = ws_pop(); ws_store(b, a);"); break;
+            case RETRIEVE: c.append("a = ws_pop(); ws_push(ws_retrieve(a));"); break;
+
+            // Flow control
+            case MARK: c.append("/* MARK " + in.arg.toString() + " */"); break;
+            case CALL:
+                c.append("ws_call(" + to_string(sites) + "); goto " + target + ";");
+                if(returns) {
+                    c.append(" R" + to_string(sites) + ":;");
+                }
+                sites++;
+                break;
+            case JUMP: c.append("goto " + target + ";"); break;
+            case JUMPZERO: c.append("if(ws_pop() == 0) goto " + target + ";"); break;
+            case JUMPNEG: c.append("if(ws_pop() < 0) goto " + target + ";"); break;
+            case ENDSUB: c.append("goto ws_endsub;"); break;
+            case ENDPROG: c.append("goto ws_end;"); break;
+
+            // I/O operations
+            case WRITEC: c.append("ws_writec(ws_pop());"); break;
+            case WRITEN: c.append("ws_writen(ws_pop());"); break;
+            case READC: c.append("a = ws_pop(); ws_store(a, ws_readc());"); break;
+            case READN: c.append("a = ws_pop(); ws_store(a, ws_readn());"); break;
+
+            // Superinstructions
+            case PUSHADD: c.append("ws_push(ws_add(ws_pop(), " + arg + "));"); break;
+            case PUSHSUB: c.append("ws_push(ws_sub(ws_pop(), " + arg + "));"); break;
+            case PUSHMUL: c.append("ws_push(ws_mul(ws_pop(), " + arg + "));"); break;
+            case PUSHRETRIEVE: c.append("ws_push(ws_retrieve(" + arg + "));"); break;
+            case PUSHSTORE: c.append("ws_store(" + arg + ", ws_pop());"); break;
+            case PUSHWRITEC: c.append("ws_writec(" + arg + ");"); break;
+            case DUPJUMPZERO: c.append("if(*ws_peek(0) == 0) goto " + target + ";"); break;
+            case DUPJUMPNEG: c.append("if(*ws_peek(0) < 0) goto " + target + ";"); break;
+
+            // The C compiler sees the loop itself
+            case WRITESTRING: case FILLHEAP: case COPYHEAP: c.append("/* loop idiom */"); break;
+            default: throw InstructionNotFoundException();
+        }
+        c.append("\n");
+    }
+    if(targets.count(size)) {
+        c.append(label(size) + ":\n");
+    }
+    c.append("    goto ws_end;\n");
+
+    // ENDSUB jumps back to the instruction after the CALL it returns from
+    if(returns) {
+        c.append("ws_endsub:\n");
+        c.append("    switch(ws_return()) {\n");
+        for(unsigned site = 0; site < sites; site++) {
+            c.append("        case " + to_string(site) + ": goto R" + to_string(site) + ";\n");
+        }
+        c.append("    }\n");
+    }
+    c.append("ws_end:\n");
+    c.append("    fflush(stdout);\n");
+    c.append("    return 0;\n");
+    c.append("}\n");
+    return c;
+}
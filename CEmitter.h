@@ -0,0 +1,23 @@
+#ifndef CEMITTER_H
+#define CEMITTER_H
+
+#include <string>
+
+#include "Types.h"
+#include "Exceptions.h"
+
+// Translates a linked Program into a standalone C file. Branch targets
+// become C labels, and every CALL site gets an index that ENDSUB switches
+// on, so the system compiler can turn the program into a native binary.
+// The generated file includes WhitespaceRuntime.h for the stack and heap.
+// Unlike the interpreter it uses machine words, and stops on overflow.
+class CEmitter {
+    public:
+        std::string emit(const Program &);
+
+    private:
+        std::string literal(const Cell &);
+        std::string label(unsigned);
+};
+
+#endif
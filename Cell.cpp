@@ -0,0 +1,47 @@
+#include "Cell.h"
+
+using namespace std;
+
+// Demotes to a small integer whenever the value fits
+Cell::Cell(const BigInt &value) {
+    if(value.fitsLong()) {
+        long small = value.toLong();
+        if(small >= SMALL_MIN && small <= SMALL_MAX) {
+            bits = (long)((unsigned long)small << 1);
+            return;
+        }
+    }
+    bits = box(value);
+}
+
+long Cell::box(const BigInt &value) {
+    Box *box = new Box;
+    box->references = 1;
+    box->value = value;
+    return (long)box | 1;
+}
+
+void Cell::release() {
+    Box *box = (Box *)(bits - 1);
+    if(--box->references == 0) {
+        delete box;
+    }
+}
+
+BigInt Cell::toBigInt() const {
+    return (isSmall() ? BigInt(small()) : big());
+}
+
+string Cell::toString() const {
+    return (isSmall() ? to_string(small()) : big().toString());
+}
+
+Cell Cell::parse(const string &text) {
+    return Cell(BigInt::parse(text));
+}
+
+Cell Cell::divideSlow(const Cell &a, const Cell &b, bool modulo) {
+    BigInt quotient, remainder;
+    BigInt::divide(a.toBigInt(), b.toBigInt(), quotient, remainder);
+    return Cell(modulo ? remainder : quotient);
+}
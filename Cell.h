@@ -0,0 +1,190 @@
+#ifndef CELL_H
+#define CELL_H
+
+#include <string>
+#include <atomic>
+#include <climits>
+
+#include "BigInt.h"
+#include "Exceptions.h"
+
+// A Whitespace integer. Whitespace integers are unbounded, but almost all
+// of them fit in a machine word, so a cell is a single tagged word:
+//
+//   ...value...0   small integer, the value shifted left by one
+//   ...pointer.1   pointer to a reference-counted BigInt
+//
+// The tagging keeps sign and zero tests on small integers free, and lets
+// ADD and SUB work on the tagged words directly. Only an overflowing
+// operation or a large literal promotes a cell to a BigInt, and results
+// that fit again are demoted, so the fast path never allocates.
+class Cell {
+    public:
+        static const long SMALL_MIN = LONG_MIN >> 1;
+        static const long SMALL_MAX = LONG_MAX >> 1;
+
+        Cell() : bits(0) {}
+
+        Cell(long value) {
+            if(value >= SMALL_MIN && value <= SMALL_MAX) {
+                bits = (long)((unsigned long)value << 1);
+            } else {
+                bits = box(BigInt(value));
+            }
+        }
+
+        Cell(const BigInt &);
+
+        Cell(const Cell &other) : bits(other.bits) {
+            if(!isSmall()) {
+                retain();
+            }
+        }
+
+        Cell(Cell &&other) noexcept : bits(other.bits) {
+            other.bits = 0;
+        }
+
+        ~Cell() {
+            if(!isSmall()) {
+                release();
+            }
+        }
+
+        Cell &operator=(const Cell &other) {
+            if(!other.isSmall()) {
+                other.retain();
+            }
+            if(!isSmall()) {
+                release();
+            }
+            bits = other.bits;
+            return *this;
+        }
+
+        Cell &operator=(Cell &&other) noexcept {
+            if(this != &other) {
+                if(!isSmall()) {
+                    release();
+                }
+                bits = other.bits;
+                other.bits = 0;
+            }
+            return *this;
+        }
+
+        // Exchanging two cells never changes a reference count
+        friend void swap(Cell &a, Cell &b) noexcept {
+            std::swap(a.bits, b.bits);
+        }
+
+        bool isSmall() const {
+            return (bits & 1) == 0;
+        }
+
+        long small() const {
+            return bits >> 1;
+        }
+
+        bool isZero() const {
+            return bits == 0; // A BigInt cell is never zero
+        }
+
+        bool isNegative() const {
+            return (isSmall() ? bits < 0 : big().isNegative());
+        }
+
+        // For arguments that must fit in a machine word, like addresses
+        long toLong() const {
+            if(!isSmall()) {
+                throw OutOfBoundsException();
+            }
+            return small();
+        }
+
+        BigInt toBigInt() const;
+        std::string toString() const;
+        static Cell parse(const std::string &);
+
+        // The raw tagged word, for the JIT. Only small cells may be passed
+        // through generated code, which doesn't maintain reference counts.
+        long toBits() const {
+            return bits;
+        }
+
+        static Cell fromBits(long bits) {
+            Cell cell;
+            cell.bits = bits;
+            if(!cell.isSmall()) {
+                cell.retain();
+            }
+            return cell;
+        }
+
+        friend Cell operator+(const Cell &a, const Cell &b) {
+            long sum;
+            if(a.isSmall() && b.isSmall() && !__builtin_add_overflow(a.bits, b.bits, &sum)) {
+                return fromBits(sum);
+            }
+            return Cell(a.toBigInt() + b.toBigInt());
+        }
+
+        friend Cell operator-(const Cell &a, const Cell &b) {
+            long difference;
+            if(a.isSmall() && b.isSmall() && !__builtin_sub_overflow(a.bits, b.bits, &difference)) {
+                return fromBits(difference);
+            }
+            return Cell(a.toBigInt() - b.toBigInt());
+        }
+
+        friend Cell operator*(const Cell &a, const Cell &b) {
+            long product;
+            // Only one of the two factors is untagged, so the product stays tagged
+            if(a.isSmall() && b.isSmall() && !__builtin_mul_overflow(a.bits, b.small(), &product)) {
+                return fromBits(product);
+            }
+            return Cell(a.toBigInt() * b.toBigInt());
+        }
+
+        friend Cell operator/(const Cell &a, const Cell &b) {
+            if(b.isZero()) {
+                throw DivisionByZeroException();
+            }
+            if(a.isSmall() && b.isSmall()) {
+                return Cell(a.small() / b.small()); // May promote for SMALL_MIN / -1
+            }
+            return divideSlow(a, b, false);
+        }
+
+        friend Cell operator%(const Cell &a, const Cell &b) {
+            if(b.isZero()) {
+                throw DivisionByZeroException();
+            }
+            if(a.isSmall() && b.isSmall()) {
+                return fromBits((long)((unsigned long)(a.small() % b.small()) << 1));
+            }
+            return divideSlow(a, b, true);
+        }
+
+    private:
+        struct Box {
+            std::atomic<unsigned> references;
+            BigInt value;
+        };
+
+        long bits;
+
+        const BigInt &big() const {
+            return ((Box *)(bits - 1))->value;
+        }
+
+        void retain() const {
+            ((Box *)(bits - 1))->references++;
+        }
+
+        void release();
+        static long box(const BigInt &);
+        static Cell divideSlow(const Cell &, const Cell &, bool);
+};
+
+#endif
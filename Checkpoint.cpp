@@ -0,0 +1,351 @@
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Checkpoint.h"
+
+using namespace std;
+
+static const char MAGIC[4] = {'W', 'S', 'C', 'P'};
+static const int64_t PAGE_TAG = 0x45474150; // "PAGE"
+static const int64_t STATE_TAG = 0x54415453; // "STAT"
+
+// Small cells are written as their tagged word, which is even. The odd
+// words mark a BigInt, written in decimal, and a run of zero cells.
+static const int64_t BIG_CELL = 1;
+static const int64_t ZERO_CELLS = 3;
+
+static const size_t WRITE_SIZE = 1024 * 1024; // Written in pieces of this size
+
+static void appendWord(string &out, int64_t word) {
+    out.append((const char *)&word, sizeof(word));
+}
+
+static void appendCell(string &out, const Cell &cell) {
+    if(cell.isSmall()) {
+        appendWord(out, cell.toBits());
+    } else {
+        string digits = cell.toString();
+        appendWord(out, BIG_CELL);
+        appendWord(out, digits.size());
+        out.append(digits);
+    }
+}
+
+// Reads words and cells until something doesn't fit, then stays failed
+struct Reader {
+    const char *at, *end;
+    bool valid;
+
+    int64_t word() {
+        int64_t word = 0;
+        if(end - at < (ptrdiff_t)sizeof(word)) {
+            valid = false;
+        } else {
+            memcpy(&word, at, sizeof(word));
+            at += sizeof(word);
+        }
+        return word;
+    }
+
+    Cell cell() {
+        int64_t bits = word();
+        if(bits != BIG_CELL) {
+            valid = valid && (bits & 1) == 0;
+            return (valid ? Cell::fromBits(bits) : Cell());
+        }
+        int64_t length = word();
+        if(!valid || length < 0 || end - at < length) {
+            valid = false;
+            return Cell();
+        }
+        at += length;
+        try {
+            return Cell::parse(string(at - length, length));
+        } catch(InvalidNumberException &e) {
+            valid = false;
+            return Cell();
+        }
+    }
+};
+
+static bool writeAll(int fd, const string &data) {
+    size_t written = 0;
+    while(written < data.size()) {
+        ssize_t length = write(fd, data.data() + written, data.size() - written);
+        if(length <= 0) {
+            return false;
+        }
+        written += length;
+    }
+    return true;
+}
+
+Checkpoint::Checkpoint(const string &path, uint64_t sourceHash, bool optimized)
+    : path(path), sourceHash(sourceHash), optimized(optimized) {
+    fd = -1;
+    size = 0;
+    rewound = false;
+}
+
+Checkpoint::~Checkpoint() {
+    if(fd >= 0) {
+        close(fd);
+    }
+}
+
+void Checkpoint::appendPage(string &out, const Heap &heap, long page) const {
+    const Cell *cells = heap.pageCells(page);
+    appendWord(out, PAGE_TAG);
+    appendWord(out, page);
+    for(long k = 0; k < Heap::PAGE_SIZE;) {
+        long zeros = 0;
+        while(k + zeros < Heap::PAGE_SIZE && cells[k + zeros].isZero()) {
+            zeros++;
+        }
+        if(zeros > 0) {
+            appendWord(out, ZERO_CELLS);
+            appendWord(out, zeros);
+            k += zeros;
+        } else {
+            appendCell(out, cells[k++]);
+        }
+    }
+}
+
+void Checkpoint::appendState(string &out, Interpreter &interpreter) const {
+    size_t start = out.size();
+    appendWord(out, STATE_TAG);
+    appendWord(out, interpreter.pc);
+    appendWord(out, interpreter.executed);
+    appendWord(out, interpreter.console.inputOffset());
+    appendWord(out, interpreter.console.outputOffset());
+    appendWord(out, interpreter.stack.size());
+    for(size_t k = 0; k < interpreter.stack.size(); k++) {
+        appendCell(out, interpreter.stack[k]);
+    }
+    appendWord(out, interpreter.callStack.size());
+    for(unsigned pc : interpreter.callStack) {
+        appendWord(out, pc);
+    }
+    appendWord(out, out.size() - start); // Marks the checkpoint complete
+}
+
+// Continues where the last complete checkpoint left off. Returns false if
+// there is none for this program, and the Interpreter is left alone.
+bool Checkpoint::outputRewound() const {
+    return rewound;
+}
+
+bool Checkpoint::restore(Interpreter &interpreter) {
+    int file = open(path.c_str(), O_RDWR);
+    if(file < 0) {
+        return false;
+    }
+    struct stat info;
+    string contents;
+    if(fstat(file, &info) == 0) {
+        contents.resize(info.st_size);
+        size_t length = 0;
+        ssize_t chunk = 1;
+        while(length < contents.size() && (chunk = read(file, &contents[length], contents.size() - length)) > 0) {
+            length += chunk;
+        }
+        contents.resize(length);
+    }
+
+    Header header;
+    if(contents.size() < sizeof(header)) {
+        close(file);
+        return false;
+    }
+    memcpy(&header, contents.data(), sizeof(header));
+    if(memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION || header.sourceHash != sourceHash ||
+       ((header.flags & OPTIMIZED) != 0) != optimized) {
+        close(file);
+        return false;
+    }
+
+    // Pages are only stored once the state record after them is complete
+    Reader reader = {contents.data() + sizeof(header), contents.data() + contents.size(), true};
+    unsigned size = interpreter.p.size();
+    vector<pair<long, vector<Cell> > > pending;
+    vector<Cell> stack;
+    vector<unsigned> callStack;
+    int64_t pc = -1, executed = 0, inputOffset = 0, outputOffset = 0;
+    size_t committed = 0;
+
+    while(reader.valid && reader.at < reader.end) {
+        const char *record = reader.at;
+        int64_t tag = reader.word();
+        if(tag == PAGE_TAG) {
+            long page = reader.word();
+            reader.valid = reader.valid && page >= 0 && page <= LONG_MAX / Heap::PAGE_SIZE;
+            vector<Cell> cells;
+            cells.reserve(Heap::PAGE_SIZE);
+            while(reader.valid && (long)cells.size() < Heap::PAGE_SIZE) {
+                const char *at = reader.at;
+                if(reader.word() == ZERO_CELLS) {
+                    int64_t zeros = reader.word();
+                    if(zeros <= 0 || zeros > Heap::PAGE_SIZE - (long)cells.size()) {
+                        reader.valid = false;
+                    }
+                    cells.resize(reader.valid ? cells.size() + zeros : cells.size());
+                } else {
+                    reader.at = at;
+                    cells.push_back(reader.cell());
+                }
+            }
+            pending.push_back(make_pair(page, move(cells)));
+        } else if(tag == STATE_TAG) {
+            int64_t recordPc = reader.word(), recordExecuted = reader.word();
+            int64_t recordInput = reader.word(), recordOutput = reader.word();
+            vector<Cell> recordStack;
+            vector<unsigned> recordCalls;
+            int64_t count = reader.word();
+            for(int64_t k = 0; k < count && reader.valid; k++) {
+                recordStack.push_back(reader.cell());
+            }
+            count = reader.word();
+            for(int64_t k = 0; k < count && reader.valid; k++) {
+                int64_t returnPc = reader.word();
+                reader.valid = reader.valid && returnPc >= 0 && returnPc <= size;
+                recordCalls.push_back(returnPc);
+            }
+            int64_t length = reader.word();
+            if(!reader.valid || length != reader.at - record - (ptrdiff_t)sizeof(length) || recordPc < 0 || recordPc > size) {
+                break;
+            }
+            for(auto &page : pending) {
+                for(long k = 0; k < Heap::PAGE_SIZE; k++) {
+                    interpreter.heap.store(page.first * Heap::PAGE_SIZE + k, page.second[k]);
+                }
+            }
+            pending.clear();
+            pc = recordPc;
+            executed = recordExecuted;
+            inputOffset = recordInput;
+            outputOffset = recordOutput;
+            stack = move(recordStack);
+            callStack = move(recordCalls);
+            committed = reader.at - contents.data();
+        } else {
+            break;
+        }
+    }
+    if(pc < 0) {
+        close(file);
+        return false;
+    }
+
+    interpreter.heap.takeDirtyPages(); // Already in the file
+    for(const Cell &cell : stack) {
+        interpreter.stack.push(cell);
+    }
+    interpreter.callStack = callStack;
+    interpreter.pc = pc;
+    interpreter.executed = executed;
+    rewound = interpreter.console.resume(inputOffset, outputOffset);
+
+    // A checkpoint that was cut off is dropped, the next one goes in its place
+    if(ftruncate(file, committed) != 0 || lseek(file, committed, SEEK_SET) < 0) {
+        close(file);
+        file = -1;
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    fd = file;
+    this->size = committed;
+    return true;
+}
+
+// Best effort, the program keeps running if it fails. Only called between
+// slices of Interpreter::run().
+bool Checkpoint::save(Interpreter &interpreter) {
+    try {
+        interpreter.console.flush(); // The output offset must be on disk
+    } catch(OutputException &e) {
+        return false;
+    }
+    uint64_t heapBytes = interpreter.heap.pageCount() * Heap::PAGE_SIZE * sizeof(Cell);
+    if(fd < 0 || size > 4 * heapBytes + WRITE_SIZE) {
+        return rewrite(interpreter);
+    }
+
+    string buffer;
+    bool written = true;
+    for(long page : interpreter.heap.takeDirtyPages()) {
+        appendPage(buffer, interpreter.heap, page);
+        if(buffer.size() >= WRITE_SIZE) {
+            written = written && writeAll(fd, buffer);
+            buffer.clear();
+        }
+    }
+    appendState(buffer, interpreter);
+    written = written && writeAll(fd, buffer) && fdatasync(fd) == 0;
+
+    if(!written) { // The pages written so far are gone, so start over next time
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    size = lseek(fd, 0, SEEK_CUR);
+    return true;
+}
+
+// Writes all pages under a temporary name, then replaces the log
+bool Checkpoint::rewrite(Interpreter &interpreter) {
+    string temporary = path + "." + to_string(getpid());
+    int file = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(file < 0) {
+        return false;
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.sourceHash = sourceHash;
+    header.flags = (optimized ? OPTIMIZED : 0);
+
+    string buffer((const char *)&header, sizeof(header));
+    bool written = true;
+    interpreter.heap.takeDirtyPages();
+    for(long page : interpreter.heap.pageNumbers()) {
+        appendPage(buffer, interpreter.heap, page);
+        if(buffer.size() >= WRITE_SIZE) {
+            written = written && writeAll(file, buffer);
+            buffer.clear();
+        }
+    }
+    appendState(buffer, interpreter);
+    written = written && writeAll(file, buffer) && fdatasync(file) == 0;
+
+    if(!written || rename(temporary.c_str(), path.c_str()) != 0) {
+        close(file);
+        unlink(temporary.c_str());
+        if(fd >= 0) {
+            close(fd); // The dirty pages are gone, so the old log can't be added to
+            fd = -1;
+        }
+        return false;
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    fd = file;
+    size = lseek(fd, 0, SEEK_CUR);
+    return true;
+}
+
+void Checkpoint::remove() {
+    if(fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    unlink(path.c_str());
+}
@@ -0,0 +1,57 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "Interpreter.h"
+
+// Saves the state of an Interpreter that is run a slice at a time, and
+// restores it into a new Interpreter for the same program. The file is a
+// log: the first checkpoint writes every heap page, later ones only the
+// pages stored to since the one before, each followed by the rest of the
+// state. A checkpoint counts once its state record is complete, so a crash
+// while one is written leaves the previous one intact. When the log has
+// grown to several times the size of the heap, it's written from scratch.
+//
+// Layout, in host byte order:
+//   Header       magic, version, source hash, flags
+//   Page         tag, page number, cells with runs of zeros collapsed
+//   State        tag, pc, instruction count, I/O offsets, both stacks, length
+class Checkpoint {
+    public:
+        static const uint32_t VERSION = 4;
+
+        Checkpoint(const std::string &, uint64_t, bool);
+        ~Checkpoint();
+        bool restore(Interpreter &);
+        bool outputRewound() const; // Whether restore() dropped the output after the checkpoint
+        bool save(Interpreter &);
+        void remove(); // Once the program has ended
+
+    private:
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint64_t sourceHash;
+            uint32_t flags;
+            uint32_t reserved;
+        };
+
+        static const uint32_t OPTIMIZED = 1;
+
+        std::string path;
+        uint64_t sourceHash;
+        bool optimized;
+        int fd; // Open for appending after the first save or a restore
+        uint64_t size; // Bytes of complete checkpoints in the file
+        bool rewound;
+
+        bool rewrite(Interpreter &);
+        void appendPage(std::string &, const Heap &, long) const;
+        void appendState(std::string &, Interpreter &) const;
+};
+
+#endif
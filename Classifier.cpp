@@ -0,0 +1,182 @@
+#include "Classifier.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Maps a byte to its Token, or to IGNORE for comment bytes
+static const unsigned char IGNORE = 0xFF;
+
+struct TokenTable {
+    unsigned char tokens[256];
+
+    TokenTable() {
+        for(int k = 0; k < 256; k++) {
+            tokens[k] = IGNORE;
+        }
+        tokens[(unsigned char)'\n'] = LINEFEED;
+        tokens[(unsigned char)' '] = SPACE;
+        tokens[(unsigned char)'\t'] = TAB;
+    }
+};
+
+static const TokenTable table;
+
+Classifier::Classifier() {
+    select(detect());
+}
+
+Classifier::Classifier(Level level) {
+    select(level <= detect() ? level : detect());
+}
+
+Classifier::Level Classifier::level() const {
+    return current;
+}
+
+Classifier::Level Classifier::detect() {
+#if defined(__x86_64__) && defined(__GNUC__)
+    if(__builtin_cpu_supports("avx2")) {
+        return AVX2;
+    }
+    return SSE2; // Part of x86-64 itself
+#else
+    return SCALAR;
+#endif
+}
+
+const char *Classifier::name(Level level) {
+    switch(level) {
+        case AVX2: return "avx2";
+        case SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+void Classifier::select(Level level) {
+    current = level;
+    switch(level) {
+        case AVX2: function = &Classifier::compactAvx2; break;
+        case SSE2: function = &Classifier::compactSse2; break;
+        default: function = &Classifier::compactScalar; break;
+    }
+}
+
+// One byte at a time, for other hosts and for the tails of the SIMD loops
+size_t Classifier::compactScalar(const char *data, size_t size, unsigned char *tokens) {
+    size_t count = 0;
+    for(size_t k = 0; k < size; k++) {
+        unsigned char token = table.tokens[(unsigned char)data[k]];
+        tokens[count] = token;
+        count += (token != IGNORE);
+    }
+    return count;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// Compares a block against the three token characters. A block without any
+// tokens costs a single test and a block with only tokens is translated
+// with vector operations.
+size_t Classifier::compactSse2(const char *data, size_t size, unsigned char *tokens) {
+    const __m128i linefeed = _mm_set1_epi8('\n'), space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i one = _mm_set1_epi8(SPACE), two = _mm_set1_epi8(TAB);
+    size_t count = 0, k = 0;
+
+    for(; k + 16 <= size; k += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(data + k));
+        __m128i isSpace = _mm_cmpeq_epi8(bytes, space), isTab = _mm_cmpeq_epi8(bytes, tab);
+        __m128i significant = _mm_or_si128(_mm_or_si128(isSpace, isTab), _mm_cmpeq_epi8(bytes, linefeed));
+        unsigned mask = _mm_movemask_epi8(significant);
+
+        if(mask == 0) {
+            continue;
+        }
+        if(mask == 0xFFFF) {
+            __m128i translated = _mm_or_si128(_mm_and_si128(isSpace, one), _mm_and_si128(isTab, two));
+            _mm_storeu_si128((__m128i *)(tokens + count), translated);
+            count += 16;
+            continue;
+        }
+        // Mixed blocks store every byte and only advance past the tokens,
+        // instead of branching on each of them
+        for(int bit = 0; bit < 16; bit++) {
+            tokens[count] = table.tokens[(unsigned char)data[k + bit]];
+            count += (mask >> bit) & 1;
+        }
+    }
+    return count + compactScalar(data + k, size - k, tokens + count);
+}
+
+// For every 8-bit mask, the positions of its set bits, to compact 8 bytes
+// with a single shuffle
+struct ShuffleTable {
+    unsigned char positions[256][8];
+
+    ShuffleTable() {
+        for(int mask = 0; mask < 256; mask++) {
+            int count = 0;
+            for(int bit = 0; bit < 8; bit++) {
+                if(mask & (1 << bit)) {
+                    positions[mask][count++] = bit;
+                }
+            }
+            while(count < 8) {
+                positions[mask][count++] = 0x80; // Shuffles in a zero
+            }
+        }
+    }
+};
+
+static const ShuffleTable shuffles;
+
+// Compacts the 8 low bytes of tokens selected by the mask. The store is
+// always 8 bytes wide, which fits because the output never runs ahead of
+// the input.
+__attribute__((target("avx2")))
+static inline size_t compactEight(__m128i tokens, unsigned mask, unsigned char *output) {
+    __m128i positions = _mm_loadl_epi64((const __m128i *)shuffles.positions[mask]);
+    _mm_storel_epi64((__m128i *)output, _mm_shuffle_epi8(tokens, positions));
+    return __builtin_popcount(mask);
+}
+
+__attribute__((target("avx2")))
+size_t Classifier::compactAvx2(const char *data, size_t size, unsigned char *tokens) {
+    const __m256i linefeed = _mm256_set1_epi8('\n'), space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i one = _mm256_set1_epi8(SPACE), two = _mm256_set1_epi8(TAB);
+    size_t count = 0, k = 0;
+
+    for(; k + 32 <= size; k += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(data + k));
+        __m256i isSpace = _mm256_cmpeq_epi8(bytes, space), isTab = _mm256_cmpeq_epi8(bytes, tab);
+        __m256i significant = _mm256_or_si256(_mm256_or_si256(isSpace, isTab), _mm256_cmpeq_epi8(bytes, linefeed));
+        unsigned mask = _mm256_movemask_epi8(significant);
+
+        if(mask == 0) {
+            continue;
+        }
+        if(mask == 0xFFFFFFFF) {
+            __m256i translated = _mm256_or_si256(_mm256_and_si256(isSpace, one), _mm256_and_si256(isTab, two));
+            _mm256_storeu_si256((__m256i *)(tokens + count), translated);
+            count += 32;
+            continue;
+        }
+        __m256i translated = _mm256_or_si256(_mm256_and_si256(isSpace, one), _mm256_and_si256(isTab, two));
+        __m128i low = _mm256_castsi256_si128(translated), high = _mm256_extracti128_si256(translated, 1);
+        count += compactEight(low, mask & 0xFF, tokens + count);
+        count += compactEight(_mm_srli_si128(low, 8), (mask >> 8) & 0xFF, tokens + count);
+        count += compactEight(high, (mask >> 16) & 0xFF, tokens + count);
+        count += compactEight(_mm_srli_si128(high, 8), mask >> 24, tokens + count);
+    }
+    return count + compactScalar(data + k, size - k, tokens + count);
+}
+#else
+size_t Classifier::compactSse2(const char *data, size_t size, unsigned char *tokens) {
+    return compactScalar(data, size, tokens);
+}
+
+size_t Classifier::compactAvx2(const char *data, size_t size, unsigned char *tokens) {
+    return compactScalar(data, size, tokens);
+}
+#endif
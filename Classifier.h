@@ -0,0 +1,44 @@
+#ifndef CLASSIFIER_H
+#define CLASSIFIER_H
+
+#include <cstddef>
+
+#include "Types.h"
+
+// Finds the significant bytes of Whitespace source (space, tab and
+// linefeed) and compacts them into a dense buffer of Tokens, one byte per
+// token. Everything else is a comment and is dropped. On x86-64 the bytes
+// are classified 16 (SSE2) or 32 (AVX2) at a time, depending on what the
+// CPU supports; blocks without tokens are skipped in one go, which makes
+// comment-heavy sources cheap. Other hosts use the scalar loop.
+class Classifier {
+    public:
+        enum Level {
+            SCALAR, SSE2, AVX2
+        };
+
+        Classifier(); // Picks the best level the CPU supports
+        Classifier(Level);
+
+        // Writes at most size tokens to the output, returns how many
+        size_t compact(const char *data, size_t size, unsigned char *tokens) const {
+            return function(data, size, tokens);
+        }
+
+        Level level() const;
+        static Level detect();
+        static const char *name(Level);
+
+    private:
+        typedef size_t (*Function)(const char *, size_t, unsigned char *);
+
+        Level current;
+        Function function;
+
+        void select(Level);
+        static size_t compactScalar(const char *, size_t, unsigned char *);
+        static size_t compactSse2(const char *, size_t, unsigned char *);
+        static size_t compactAvx2(const char *, size_t, unsigned char *);
+};
+
+#endif
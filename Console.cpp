@@ -0,0 +1,233 @@
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Console.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+void FdSink::write(const char *data, size_t size) {
+    while(size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw OutputException();
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+// Appending writes at the end of the file, whatever the offset says
+unsigned long long FdSink::position() {
+    struct stat info;
+    if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        return 0;
+    }
+    if((fcntl(fd, F_GETFL) & O_APPEND) != 0) {
+        return info.st_size;
+    }
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    return (offset < 0 ? 0 : offset);
+}
+
+// Only truncates back to a position the file still reaches, so whatever
+// was in it before the program started stays
+bool FdSink::rewind(unsigned long long offset) {
+    struct stat info;
+    if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || (unsigned long long)info.st_size < offset) {
+        return false;
+    }
+    if((unsigned long long)info.st_size > offset && ftruncate(fd, offset) != 0) {
+        throw OutputException();
+    }
+    lseek(fd, offset, SEEK_SET);
+    return true;
+}
+
+size_t FdSource::read(char *data, size_t size) {
+    ssize_t length;
+    do {
+        length = ::read(fd, data, size);
+    } while(length < 0 && errno == EINTR);
+    return (length < 0 ? 0 : length); // Errors end the input
+}
+
+void BufferSink::write(const char *data, size_t size) {
+    buffer.append(data, size);
+}
+
+unsigned long long BufferSink::position() {
+    return buffer.size();
+}
+
+bool BufferSink::rewind(unsigned long long offset) {
+    if(offset > buffer.size()) {
+        return false;
+    }
+    buffer.resize(offset);
+    return true;
+}
+
+const string &BufferSink::contents() const {
+    return buffer;
+}
+
+size_t BufferSource::read(char *data, size_t size) {
+    size_t length = min(size, contents.size() - position);
+    memcpy(data, contents.data() + position, length);
+    position += length;
+    return length;
+}
+
+void QueueSource::append(const string &input) {
+    contents.erase(0, position); // Drop what has been read already
+    position = 0;
+    contents.append(input);
+}
+
+void QueueSource::close() {
+    closed = true;
+}
+
+size_t QueueSource::read(char *data, size_t size) {
+    if(position == contents.size()) {
+        return (closed ? 0 : BLOCKED);
+    }
+    size_t length = min(size, contents.size() - position);
+    memcpy(data, contents.data() + position, length);
+    position += length;
+    return length;
+}
+
+Console::Console(Source &source, Sink &sink)
+    : output(new char[BUFFER_SIZE]), input(new char[BUFFER_SIZE]) {
+    this->source = &source;
+    this->sink = &sink;
+    outputSize = 0;
+    inputStart = inputEnd = 0;
+    inputRead = outputWritten = 0;
+    outputBase = sink.position();
+}
+
+Console::~Console() {
+    try {
+        flush();
+    } catch(...) {
+        // Nowhere left to report it
+    }
+}
+
+// Switches to other streams; unread input of the old source is dropped
+void Console::attach(Source &source, Sink &sink) {
+    flush();
+    this->source = &source;
+    this->sink = &sink;
+    inputStart = inputEnd = 0;
+    inputRead = outputWritten = 0;
+    outputBase = sink.position();
+}
+
+void Console::write(const char *data, size_t size) {
+    if(outputSize + size > BUFFER_SIZE) {
+        flush();
+        if(size > BUFFER_SIZE) {
+            sink->write(data, size);
+            outputWritten += size;
+            return;
+        }
+    }
+    memcpy(output.get() + outputSize, data, size);
+    outputSize += size;
+}
+
+void Console::flush() {
+    if(outputSize > 0) {
+        size_t size = outputSize;
+        outputSize = 0; // Don't write it twice if the sink throws
+        sink->write(output.get(), size);
+        outputWritten += size;
+    }
+}
+
+bool Console::readToken(string &token) {
+    int character;
+    token.clear();
+    do {
+        character = readChar();
+    } while(character != -1 && isspace(character));
+    while(character != -1 && !isspace(character)) {
+        token.push_back((char)character);
+        character = readChar();
+    }
+    return !token.empty();
+}
+
+bool Console::inputReady(bool token) {
+    while(true) {
+        size_t position = inputStart;
+        if(token) { // A token is complete once whitespace follows it
+            while(position < inputEnd && isspace((unsigned char)input[position])) {
+                position++;
+            }
+            while(position < inputEnd && !isspace((unsigned char)input[position])) {
+                position++;
+            }
+            if(position < inputEnd) {
+                return true;
+            }
+        } else if(inputStart < inputEnd) {
+            return true;
+        }
+        if(inputStart == 0 && inputEnd == BUFFER_SIZE) {
+            return true; // Too long to look ahead, read what there is
+        }
+
+        // Keep what hasn't been read and add to it
+        memmove(input.get(), input.get() + inputStart, inputEnd - inputStart);
+        inputEnd -= inputStart;
+        inputStart = 0;
+        flush();
+        size_t length = source->read(input.get() + inputEnd, BUFFER_SIZE - inputEnd);
+        if(length == Source::BLOCKED) {
+            return false;
+        }
+        if(length == 0) {
+            return true; // The end of input can be read right away
+        }
+        inputEnd += length;
+        inputRead += length;
+    }
+}
+
+bool Console::resume(unsigned long long input, unsigned long long output) {
+    flush();
+    while(inputOffset() < input) {
+        if(inputStart == inputEnd && !refill()) {
+            break; // The input is shorter than before
+        }
+        inputStart += min((unsigned long long)(inputEnd - inputStart), input - inputOffset());
+    }
+    bool rewound = sink->rewind(output);
+    outputBase = sink->position();
+    outputWritten = 0;
+    return rewound;
+}
+
+// Reading may block, so the output written so far is flushed first
+bool Console::refill() {
+    flush();
+    inputStart = 0;
+    inputEnd = source->read(input.get(), BUFFER_SIZE);
+    if(inputEnd == Source::BLOCKED) {
+        inputEnd = 0; // Without a scheduler to come back later, that's the end
+    }
+    inputRead += inputEnd;
+    return inputEnd > 0;
+}
@@ -0,0 +1,159 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <string>
+#include <memory>
+#include <cstddef>
+
+// Where program output ends up
+class Sink {
+    public:
+        virtual ~Sink() {}
+        virtual void write(const char *, size_t) = 0;
+
+        // Where the next byte written ends up, like the offset in a file
+        virtual unsigned long long position() { return 0; }
+
+        // Drops everything written after the position, returns false if the
+        // sink can't or doesn't hold everything before it any more
+        virtual bool rewind(unsigned long long) { return false; }
+};
+
+// Where program input comes from. read() returns 0 at the end of input, and
+// BLOCKED when a non-blocking source has no input yet.
+class Source {
+    public:
+        static const size_t BLOCKED = (size_t)-1;
+
+        virtual ~Source() {}
+        virtual size_t read(char *, size_t) = 0;
+};
+
+// Writes to a file descriptor, like standard output
+class FdSink: public Sink {
+    public:
+        FdSink(int fd) : fd(fd) {}
+        void write(const char *, size_t);
+        unsigned long long position(); // Only regular files
+        bool rewind(unsigned long long); // Likewise
+
+    private:
+        int fd;
+};
+
+// Reads from a file descriptor, like standard input
+class FdSource: public Source {
+    public:
+        FdSource(int fd) : fd(fd) {}
+        size_t read(char *, size_t);
+
+    private:
+        int fd;
+};
+
+// Collects the output in memory
+class BufferSink: public Sink {
+    public:
+        void write(const char *, size_t);
+        unsigned long long position();
+        bool rewind(unsigned long long);
+        const std::string &contents() const;
+
+    private:
+        std::string buffer;
+};
+
+// Reads the input from memory
+class BufferSource: public Source {
+    public:
+        BufferSource(const std::string &contents) : contents(contents), position(0) {}
+        size_t read(char *, size_t);
+
+    private:
+        std::string contents;
+        size_t position;
+};
+
+// Input that arrives while the program runs, for programs that are run a
+// slice at a time. Reading from it never blocks: it returns BLOCKED until
+// more input is added, and the end of input once it's closed.
+class QueueSource: public Source {
+    public:
+        QueueSource() : position(0), closed(false) {}
+        void append(const std::string &);
+        void close();
+        size_t read(char *, size_t);
+
+    private:
+        std::string contents;
+        size_t position;
+        bool closed;
+};
+
+// Buffered I/O for the running program. Output is only passed to the sink
+// when the buffer is full, on flush() and before input is requested from
+// the source, so a prompt is always visible before the program blocks.
+// Input is read in blocks of BUFFER_SIZE.
+class Console {
+    public:
+        static const size_t BUFFER_SIZE = 64 * 1024;
+
+        Console(Source &, Sink &);
+        ~Console();
+        void attach(Source &, Sink &);
+
+        void writeChar(char character) {
+            if(outputSize == BUFFER_SIZE) {
+                flush();
+            }
+            output[outputSize++] = character;
+        }
+
+        void write(const char *, size_t);
+        void flush();
+
+        // Returns the next byte of input, or -1 at the end of input
+        int readChar() {
+            if(inputStart == inputEnd && !refill()) {
+                return -1;
+            }
+            return (unsigned char)input[inputStart++];
+        }
+
+        // Skips whitespace and reads up to the next whitespace. Returns false
+        // if the input ended before anything was read.
+        bool readToken(std::string &);
+
+        // Whether the next readChar(), or readToken() if the argument is
+        // true, can be answered without waiting for a non-blocking source
+        bool inputReady(bool);
+
+        // How much input the program has consumed and where its output has
+        // got to in the sink, and continuing from there, for checkpoints.
+        // resume() skips the input that was consumed before and drops the
+        // output written after the checkpoint. It returns false if the sink
+        // couldn't do that, and then leaves the output alone.
+        unsigned long long inputOffset() const {
+            return inputRead - (inputEnd - inputStart);
+        }
+
+        unsigned long long outputOffset() const {
+            return outputBase + outputWritten + outputSize;
+        }
+
+        bool resume(unsigned long long, unsigned long long);
+
+    private:
+        Source *source;
+        Sink *sink;
+        std::unique_ptr<char[]> output;
+        std::unique_ptr<char[]> input;
+        size_t outputSize;
+        size_t inputStart, inputEnd; // The unread part of input
+        unsigned long long inputRead, outputWritten; // Through the source and sink
+        unsigned long long outputBase; // Position of the sink when it was attached
+
+        bool refill();
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef DECODETABLE_H
+#define DECODETABLE_H
+
+#include "Types.h"
+
+// The Whitespace instruction grammar as a trie over the three tokens,
+// generated at compile time. A node of the trie is identified by its path
+// from the root: every token adds a base-4 digit (token + 1), so the node
+// reached by token t from node n is n * 4 + t + 1. The longest instruction
+// is four tokens, so every node fits in DECODE_STATES entries.
+//
+// Decoding an instruction is a walk from the root until the entry is no
+// longer CONTINUE. What remains is either INVALID or tells the parser which
+// argument the opcode takes.
+
+enum DecodeKind {
+    CONTINUE, // Inside the trie, read another token
+    INVALID, // No instruction starts with these tokens
+    NO_ARGUMENT, NUMBER_ARGUMENT, LABEL_ARGUMENT // An instruction, and its argument
+};
+
+struct DecodeEntry {
+    DecodeKind kind;
+    Opcode op;
+};
+
+struct DecodeRule {
+    unsigned path;
+    unsigned length; // In tokens
+    Opcode op;
+    DecodeKind kind;
+};
+
+static const unsigned DECODE_STATES = 256;
+
+constexpr unsigned decodePath(Token a, Token b) {
+    return (a + 1) * 4 + b + 1;
+}
+
+constexpr unsigned decodePath(Token a, Token b, Token c) {
+    return decodePath(a, b) * 4 + c + 1;
+}
+
+constexpr unsigned decodePath(Token a, Token b, Token c, Token d) {
+    return decodePath(a, b, c) * 4 + d + 1;
+}
+
+constexpr DecodeRule decodeRule(unsigned path, unsigned length, Opcode op, DecodeKind kind) {
+    return DecodeRule{path, length, op, kind};
+}
+
+// Instruction modification parameter followed by the command
+constexpr DecodeRule DECODE_RULES[] = {
+    // Stack manipulations: S
+    decodeRule(decodePath(SPACE, SPACE), 2, PUSH, NUMBER_ARGUMENT),
+    decodeRule(decodePath(SPACE, LINEFEED, SPACE), 3, DUP, NO_ARGUMENT),
+    decodeRule(decodePath(SPACE, TAB, SPACE), 3, COPY, NUMBER_ARGUMENT),
+    decodeRule(decodePath(SPACE, LINEFEED, TAB), 3, SWAP, NO_ARGUMENT),
+    decodeRule(decodePath(SPACE, LINEFEED, LINEFEED), 3, DISCARD, NO_ARGUMENT),
+    decodeRule(decodePath(SPACE, TAB, LINEFEED), 3, SLIDE, NUMBER_ARGUMENT),
+
+    // Arithmetic: TS
+    decodeRule(decodePath(TAB, SPACE, SPACE, SPACE), 4, ADD, NO_ARGUMENT),
+    decodeRule(decodePath(TAB, SPACE, SPACE, TAB), 4, SUB, NO_ARGUMENT),
+    decodeRule(decodePath(TAB, SPACE, SPACE, LINEFEED), 4, MUL, NO_ARGUMENT),
+    decodeRule(decodePath(TAB, SPACE, TAB, SPACE), 4, DIV, NO_ARGUMENT),
+    decodeRule(decodePath(TAB, SPACE, TAB, TAB), 4, MOD, NO_ARGUMENT),
+
+    // Heap access: TT
+    decodeRule(decodePath(TAB, TAB, SPACE), 3, STORE, NO_ARGUMENT),
+    decodeRule(decodePath(TAB, TAB, TAB), 3, RETRIEVE, NO_ARGUMENT),
+
+    // Flow control: LF
+    decodeRule(decodePath(LINEFEED, SPACE, SPACE), 3, MARK, LABEL_ARGUMENT),
+    decodeRule(decodePath(LINEFEED, SPACE, TAB), 3, CALL, LABEL_ARGUMENT),
+    decodeRule(decodePath(LINEFEED, SPACE, LINEFEED), 3, JUMP, LABEL_ARGUMENT),
+    decodeRule(decodePath(LINEFEED, TAB, SPACE), 3, JUMPZERO, LABEL_ARGUMENT),
+    decodeRule(decodePath(LINEFEED, TAB, TAB), 3, JUMPNEG, LABEL_ARGUMENT),
+    decodeRule(decodePath(LINEFEED, TAB, LINEFEED), 3, ENDSUB, NO_ARGUMENT),
+    decodeRule(decodePath(LINEFEED, LINEFEED, LINEFEED), 3, ENDPROG, NO_ARGUMENT),
+
+    // I/O: TLF
+    decodeRule(decodePath(TAB, LINEFEED, SPACE, SPACE), 4, WRITEC, NO_ARGUMENT),
+    decodeRule(decodePath(TAB, LINEFEED, SPACE, TAB), 4, WRITEN, NO_ARGUMENT),
+    decodeRule(decodePath(TAB, LINEFEED, TAB, SPACE), 4, READC, NO_ARGUMENT),
+    decodeRule(decodePath(TAB, LINEFEED, TAB, TAB), 4, READN, NO_ARGUMENT)
+};
+
+static const unsigned DECODE_RULE_COUNT = sizeof(DECODE_RULES) / sizeof(DECODE_RULES[0]);
+
+// Number of tokens on the path to a node
+constexpr unsigned decodeDepth(unsigned path) {
+    return (path == 0 ? 0 : 1 + decodeDepth(path >> 2));
+}
+
+constexpr bool decodeIsPrefix(unsigned path, const DecodeRule &rule) {
+    return decodeDepth(path) < rule.length &&
+           (rule.path >> (2 * (rule.length - decodeDepth(path)))) == path;
+}
+
+// The grammar is prefix-free, so a node is either an instruction, on the
+// way to one, or invalid
+constexpr DecodeEntry decodeEntry(unsigned path, unsigned rule = 0) {
+    return (rule == DECODE_RULE_COUNT ? DecodeEntry{INVALID, PUSH} :
+            DECODE_RULES[rule].path == path ? DecodeEntry{DECODE_RULES[rule].kind, DECODE_RULES[rule].op} :
+            decodeIsPrefix(path, DECODE_RULES[rule]) ? DecodeEntry{CONTINUE, PUSH} :
+            decodeEntry(path, rule + 1));
+}
+
+// Expands decodeEntry for every node, 0 to DECODE_STATES - 1
+template<unsigned... Paths>
+struct DecodeTable {
+    static constexpr DecodeEntry entries[sizeof...(Paths)] = {decodeEntry(Paths)...};
+};
+
+template<unsigned... Paths>
+constexpr DecodeEntry DecodeTable<Paths...>::entries[sizeof...(Paths)];
+
+template<unsigned Count, unsigned... Paths>
+struct MakeDecodeTable : MakeDecodeTable<Count - 1, Count - 1, Paths...> {};
+
+template<unsigned... Paths>
+struct MakeDecodeTable<0, Paths...> : DecodeTable<Paths...> {};
+
+typedef MakeDecodeTable<DECODE_STATES> Decoder;
+
+static_assert(Decoder::entries[decodePath(TAB, LINEFEED, TAB, TAB)].op == READN, "READN is misplaced");
+static_assert(Decoder::entries[decodePath(TAB, LINEFEED, LINEFEED)].kind == INVALID, "TLF LF is no instruction");
+static_assert(Decoder::entries[decodePath(TAB, SPACE)].kind == CONTINUE, "TS starts arithmetic");
+
+#endif
@@ -2,6 +2,7 @@
 #define EXCEPTIONS_H
 
 #include <exception>
+#include <string>
 
 class UnreachableTokenException: public std::exception {
     virtual const char *what() const throw () {
@@ -48,9 +49,103 @@ class InstructionNotFoundException: public std::exception {
     }
 };
 
-class LabelNotFoundException: public std::exception {
+// Label errors carry the offending label, so the message is built at
+// construction time instead of being a fixed string.
+class LabelException: public std::exception {
+    public:
+        LabelException(const std::string &message, const std::string &label) {
+            this->message = message + " (label " + label + ")";
+        }
+        virtual ~LabelException() throw () {}
+        virtual const char *what() const throw () {
+            return message.c_str();
+        }
+
+    private:
+        std::string message;
+};
+
+class LabelNotFoundException: public LabelException {
+    public:
+        LabelNotFoundException(const std::string &label)
+            : LabelException("Error: label has not been found.", label) {}
+};
+
+class DuplicateLabelException: public LabelException {
+    public:
+        DuplicateLabelException(const std::string &label)
+            : LabelException("Error: label has been defined more than once.", label) {}
+};
+
+class FileNotFoundException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: the source file could not be opened.";
+    }
+};
+
+class HeapLimitException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: the heap memory limit has been exceeded.";
+    }
+};
+
+class DivisionByZeroException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: division by zero.";
+    }
+};
+
+class InvalidNumberException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: the input is not a number.";
+    }
+};
+
+class NumberTooLargeException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: number is too large to be compiled to C.";
+    }
+};
+
+class OutputException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: the output could not be written.";
+    }
+};
+
+class StackOverflowException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: the value stack has overflowed.";
+    }
+};
+
+class StackUnderflowException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: the value stack holds fewer values than the instruction needs.";
+    }
+};
+
+class CallStackOverflowException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: subroutine calls are nested too deeply.";
+    }
+};
+
+class ReturnWithoutCallException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: ENDSUB without a matching CALL.";
+    }
+};
+
+class SocketException: public std::exception {
+    virtual const char *what() const throw () {
+        return "Error: the socket could not be set up.";
+    }
+};
+
+class ConnectionException: public std::exception {
     virtual const char *what() const throw () {
-        return "Error: label has not been found.";
+        return "Error: the server closed the connection.";
     }
 };
 
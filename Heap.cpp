@@ -0,0 +1,149 @@
+#include <algorithm>
+
+#include "Heap.h"
+
+using namespace std;
+
+Heap::Heap(size_t limit) {
+    this->limit = limit;
+}
+
+Cell *const *Heap::directoryData() const {
+    return directory.data();
+}
+
+size_t Heap::directorySize() const {
+    return directory.size();
+}
+
+size_t Heap::pageCount() const {
+    return pages.size();
+}
+
+// Slow path of load: negative, distant or untouched addresses
+const Cell &Heap::loadDistant(long address) const {
+    static const Cell zero;
+
+    if(address < 0) {
+        throw OutOfBoundsException();
+    }
+    long page = address >> PAGE_BITS;
+    if(page >= DIRECT_PAGES) {
+        auto found = distant.find(page);
+        if(found != distant.end()) {
+            return found->second[address & (PAGE_SIZE - 1)];
+        }
+    }
+    return zero; // Never written
+}
+
+// Slow path of store: allocates the page the address lies in
+void Heap::storeDistant(long address, const Cell &value) {
+    page(address)[address & (PAGE_SIZE - 1)] = value;
+}
+
+void Heap::fill(long address, long count, const Cell &value) {
+    while(count > 0) {
+        long offset = address & (PAGE_SIZE - 1), length = min(count, PAGE_SIZE - offset);
+        Cell *cells = page(address);
+        std::fill(cells + offset, cells + offset + length, value);
+        address += length;
+        count -= length;
+    }
+}
+
+void Heap::copy(long to, long from, long count) {
+    // Copying down onto itself repeats what it has just copied, as it would
+    // cell by cell
+    if(to <= from && from < to + count) {
+        for(long k = count - 1; k >= 0; k--) {
+            Cell value = load(from + k);
+            store(to + k, value);
+        }
+        return;
+    }
+    while(count > 0) {
+        long toEnd = ((to + count - 1) & (PAGE_SIZE - 1)) + 1, fromEnd = ((from + count - 1) & (PAGE_SIZE - 1)) + 1;
+        long length = min(count, min(toEnd, fromEnd));
+        Cell *cells = page(to + count - 1);
+        const Cell *source = pageCells((from + count - 1) >> PAGE_BITS);
+        if(source != NULL) {
+            copy_backward(source + fromEnd - length, source + fromEnd, cells + toEnd);
+        } else {
+            std::fill(cells + toEnd - length, cells + toEnd, Cell()); // Never written
+        }
+        count -= length;
+    }
+}
+
+// The cells of the page an address lies in, allocated if needed and marked
+// as stored to
+Cell *Heap::page(long address) {
+    if(address < 0) {
+        throw OutOfBoundsException();
+    }
+    long page = address >> PAGE_BITS;
+    Cell *cells;
+
+    if(page < DIRECT_PAGES) {
+        if(page >= (long)directory.size()) {
+            directory.resize(page + 1, NULL);
+            dirty.resize(page + 1, 0);
+        }
+        if(directory[page] == NULL) {
+            directory[page] = allocatePage();
+        }
+        cells = directory[page];
+        dirty[page] = 1;
+    } else {
+        auto found = distant.find(page);
+        if(found == distant.end()) {
+            found = distant.insert(make_pair(page, allocatePage())).first;
+        }
+        cells = found->second;
+        dirtyDistant.insert(page);
+    }
+    return cells;
+}
+
+vector<long> Heap::takeDirtyPages() {
+    vector<long> numbers;
+    for(size_t page = 0; page < dirty.size(); page++) {
+        if(dirty[page]) {
+            numbers.push_back(page);
+            dirty[page] = 0;
+        }
+    }
+    numbers.insert(numbers.end(), dirtyDistant.begin(), dirtyDistant.end());
+    dirtyDistant.clear();
+    return numbers;
+}
+
+vector<long> Heap::pageNumbers() const {
+    vector<long> numbers;
+    for(size_t page = 0; page < directory.size(); page++) {
+        if(directory[page] != NULL) {
+            numbers.push_back(page);
+        }
+    }
+    for(auto &page : distant) {
+        numbers.push_back(page.first);
+    }
+    return numbers;
+}
+
+const Cell *Heap::pageCells(long page) const {
+    if(page >= 0 && page < (long)directory.size()) {
+        return directory[page];
+    }
+    auto found = distant.find(page);
+    return (found == distant.end() ? NULL : found->second);
+}
+
+Cell *Heap::allocatePage() {
+    if((pages.size() + 1) * PAGE_SIZE * sizeof(Cell) > limit) {
+        throw HeapLimitException();
+    }
+    pages.push_back(unique_ptr<Cell[]>(new Cell[PAGE_SIZE])); // All zero
+    return pages.back().get();
+}
@@ -0,0 +1,78 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstddef>
+
+#include "Exceptions.h"
+#include "Cell.h"
+
+// Sparse heap made of fixed-size pages that are allocated on first store.
+// Addresses are translated with a shift and a mask: pages below
+// DIRECT_PAGES are found in a flat directory, the few beyond that in a hash
+// table. Addresses that were never written read as zero, so memory use
+// scales with the pages a program touches, not with its highest address.
+class Heap {
+    public:
+        static const unsigned PAGE_BITS = 12;
+        static const long PAGE_SIZE = 1L << PAGE_BITS; // Cells per page
+        static const long DIRECT_PAGES = 1L << 20; // Covers addresses below 2^32
+        static const size_t DEFAULT_LIMIT = 1024UL * 1024 * 1024; // Bytes
+
+        Heap(size_t limit = DEFAULT_LIMIT);
+
+        const Cell &load(long address) const {
+            long page = address >> PAGE_BITS;
+            if(address >= 0 && page < (long)directory.size() && directory[page] != NULL) {
+                return directory[page][address & (PAGE_SIZE - 1)];
+            }
+            return loadDistant(address);
+        }
+
+        void store(long address, const Cell &value) {
+            long page = address >> PAGE_BITS;
+            if(address >= 0 && page < (long)directory.size() && directory[page] != NULL) {
+                directory[page][address & (PAGE_SIZE - 1)] = value;
+                dirty[page] = 1;
+            } else {
+                storeDistant(address, value);
+            }
+        }
+
+        // Stores the value in count cells from the address up, and copies
+        // count cells from one address to another as if cell by cell from
+        // the highest address down. Both work a page at a time.
+        void fill(long, long, const Cell &);
+        void copy(long, long, long);
+
+        // The flat page directory, for code that translates addresses itself
+        // Pages hold Cells, which are a single tagged word each
+        Cell *const *directoryData() const;
+        size_t directorySize() const;
+        size_t pageCount() const;
+
+        // For checkpoints: the pages stored to since the last call, the
+        // numbers of all allocated pages, and the cells of one of them.
+        // The JIT writes to pages without marking them.
+        std::vector<long> takeDirtyPages();
+        std::vector<long> pageNumbers() const;
+        const Cell *pageCells(long) const;
+
+    private:
+        std::vector<Cell *> directory; // Pages below DIRECT_PAGES, NULL if untouched
+        std::unordered_map<long, Cell *> distant; // Pages at or beyond DIRECT_PAGES
+        std::vector<unsigned char> dirty; // Per directory entry, set by store()
+        std::unordered_set<long> dirtyDistant;
+        std::vector<std::unique_ptr<Cell[]> > pages; // Owns every allocated page
+        size_t limit; // Maximum number of bytes in pages
+
+        const Cell &loadDistant(long) const;
+        void storeDistant(long, const Cell &);
+        Cell *page(long);
+        Cell *allocatePage();
+};
+
+#endif
@@ -1,216 +1,995 @@
+#include <cstdio>
+
 #include "Interpreter.h"
+#include "Jit.h"
 #include "Exceptions.h"
 
 using namespace std;
 
-Interpreter::Interpreter(Program p) {
-    this->p = p;
-}
-
-void Interpreter::interpret() {
-    unsigned pc, size = p.size();
-
-    for(pc = 0; pc < size; pc++) {
-        switch(p[pc]) {
-            // Stack manipulations
-            case PUSH: {
-                stack.push_front(p[++pc]);
-                break;
-            }
-            case DUP: {
-                stack.push_front(stack.front());
-                break;
-            }
-            case COPY: {
-                auto it = stack.begin();
-                advance(it, p[++pc]);
-                stack.push_front(*it);
-                break;
-            }
-            case SWAP: {
-                int first, second;
-                first = stack.front();
-                stack.pop_front();
-                second = stack.front();
-                stack.pop_front();
-                stack.push_front(first);
-                stack.push_front(second);
-                break;
-            }
-            case DISCARD: {
-                stack.pop_front();
-                break;
-            }
-            case SLIDE: {
-                int top;
-                top = stack.front();
-                ++pc;
-                for(int i = 0; i <= p[pc]; i++) {
-                    stack.pop_front();
-                }
-                stack.push_front(top);
-                break;
-            }
-
-            // Arithmetic
-            case ADD: {
-                int a = stack.front();
-                stack.pop_front();
-                int b = stack.front();
-                stack.pop_front();
-                stack.push_front(b + a);
-                break;
-            }
-            case SUB: {
-                int a = stack.front();
-                stack.pop_front();
-                int b = stack.front();
-                stack.pop_front();
-                stack.push_front(b - a);
-                break;
-            }
-            case MUL: {
-                int a = stack.front();
-                stack.pop_front();
-                int b = stack.front();
-                stack.pop_front();
-                stack.push_front(b * a);
-                break;
-                }
-            case DIV: {
-                int a = stack.front();
-                stack.pop_front();
-                int b = stack.front();
-                stack.pop_front();
-                stack.push_front(b / a);
-                break;
-            }
-            case MOD: {
-                int a = stack.front();
-                stack.pop_front();
-                int b = stack.front();
-                stack.pop_front();
-                stack.push_front(b % a);
-                break;
-            }
-
-            // Heap access
-            case STORE: {
-                int value = stack.front();
-                stack.pop_front();
-                int address = stack.front();
-                if(address < 0) {
-                    throw OutOfBoundsException();
-                }
-                int size = heap.size();
-                if(size < address) {
-                    for(int i = size; i < address; i++) {
-                        heap.push_back(0);
+static FdSource standardInput(0);
+static FdSink standardOutput(1);
+
+Interpreter::Interpreter(Program p, size_t stackCapacity, size_t heapLimit)
+    : Interpreter(verify(move(p)), stackCapacity, heapLimit) {
+}
+
+Interpreter::Interpreter(shared_ptr<const VerifiedProgram> verified, size_t stackCapacity, size_t heapLimit)
+    : verified(verified), p(verified->program), depthChecks(verified->depthChecks),
+      heap(heapLimit), stack(stackCapacity), console(standardInput, standardOutput) {
+    pc = 0;
+    executed = 0;
+    profiler = NULL;
+    memoizer = NULL;
+    state = YIELDED;
+}
+
+// The stack depth is only checked at the start of blocks that need it
+shared_ptr<const VerifiedProgram> Interpreter::verify(Program p) {
+    shared_ptr<VerifiedProgram> verified = make_shared<VerifiedProgram>();
+    verified->program = move(p);
+    Verifier verifier;
+    verified->depthChecks = verifier.verify(verified->program);
+    return verified;
+}
+
+// Output is flushed when the program ends, also when it ends with an error
+void Interpreter::interpret(Engine engine) {
+    try {
+        execute(engine);
+    } catch(...) {
+        console.flush();
+        throw;
+    }
+    console.flush();
+}
+
+Status Interpreter::run(unsigned long long budget) {
+    if(state == YIELDED || state == BLOCKED) {
+        try {
+            state = interpretSwitch<false, true>(budget);
+            console.flush(); // Whatever the slice wrote shows up now
+        } catch(...) {
+            failure = current_exception();
+            state = FAILED;
+            try {
+                console.flush(); // Like interpret(), the output up to the error
+            } catch(OutputException &e) {
+                // The first error is the one to report
+            }
+        }
+    }
+    return state;
+}
+
+Status Interpreter::status() const {
+    return state;
+}
+
+exception_ptr Interpreter::error() const {
+    return failure;
+}
+
+void Interpreter::redirect(Source &input, Sink &output) {
+    console.attach(input, output);
+}
+
+void Interpreter::profile(Profiler *profiler) {
+    this->profiler = profiler;
+}
+
+void Interpreter::memoize(Memoizer *memoizer) {
+    this->memoizer = memoizer;
+}
+
+void Interpreter::execute(Engine engine) {
+    if(profiler != NULL) {
+        interpretSwitch<true, false>();
+        profiler->finish();
+        return;
+    }
+    if(memoizer != NULL) {
+        engine = SWITCH_ENGINE; // The only one that asks the Memoizer
+    }
+    if(engine == JIT_ENGINE) {
+        Jit jit(*this);
+        if(jit.compile() && jit.run()) {
+            return;
+        }
+        engine = SWITCH_ENGINE; // Can't be compiled, or continues from where the JIT left off
+    }
+
+    if(engine == THREADED_ENGINE) {
+        interpretThreaded();
+    } else if(engine == CACHED_ENGINE) {
+        interpretCached();
+    } else {
+        interpretSwitch<false, false>();
+    }
+}
+
+unsigned long long Interpreter::instructionCount() const {
+    return executed;
+}
+
+// Loop idioms are shared by all engines. Each stops where the loop would
+// do something out of the ordinary, like growing a number into a BigInt or
+// failing, and leaves the stack as it would be at the start of the next
+// iteration, so the loop itself can take over from there.
+bool Interpreter::loopIdiom(unsigned pc) {
+    switch(p[pc].op) {
+        case WRITESTRING: { // [address] to [end, 0]
+            Cell &top = stack.top();
+            if(!top.isSmall() || top.isNegative()) {
+                return false;
+            }
+            long address = top.small();
+            char text[Console::BUFFER_SIZE];
+            size_t length = 0;
+            bool done = false;
+            while(address < Cell::SMALL_MAX) {
+                const Cell &character = heap.load(address);
+                if(character.isZero() || !character.isSmall()) {
+                    done = character.isZero();
+                    break;
+                }
+                text[length++] = (char)character.small();
+                if(length == sizeof(text)) {
+                    console.write(text, length);
+                    length = 0;
+                }
+                address++;
+            }
+            console.write(text, length);
+            top = Cell(address);
+            if(done) {
+                stack.push(Cell());
+            }
+            return done;
+        }
+        case FILLHEAP: { // [address, count] to [address + count, 0], storing the value of the loop's PUSH
+            Cell &count = stack.top(), &address = stack.peek(1);
+            if(!count.isSmall() || count.isNegative() || !address.isSmall() || address.isNegative() ||
+               address.small() > Cell::SMALL_MAX - count.small()) {
+                return false;
+            }
+            heap.fill(address.small(), count.small(), p[pc + 4].arg);
+            address = Cell(address.small() + count.small());
+            count = Cell();
+            return true;
+        }
+        case COPYHEAP: { // [count] to [0], from the source to the target in the loop's PUSHADDs
+            Cell &count = stack.top();
+            const Cell &target = p[pc + 4].arg, &source = p[pc + 6].arg;
+            if(!count.isSmall() || count.isNegative() || !target.isSmall() || target.isNegative() ||
+               !source.isSmall() || source.isNegative() || target.small() > Cell::SMALL_MAX - count.small() ||
+               source.small() > Cell::SMALL_MAX - count.small()) {
+                return false;
+            }
+            heap.copy(target.small(), source.small(), count.small());
+            count = Cell();
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// I/O is shared by all engines
+
+void Interpreter::writeChar(const Cell &value) {
+    console.writeChar((char)value.toLong());
+}
+
+void Interpreter::writeNumber(const Cell &value) {
+    if(value.isSmall()) {
+        char digits[24];
+        int length = snprintf(digits, sizeof(digits), "%ld", value.small());
+        console.write(digits, length);
+    } else {
+        string digits = value.toString();
+        console.write(digits.data(), digits.size());
+    }
+}
+
+// Returns -1 at the end of the input
+long Interpreter::readChar() {
+    return console.readChar();
+}
+
+Cell Interpreter::readNumber() {
+    string number;
+    if(!console.readToken(number)) {
+        throw InvalidNumberException();
+    }
+    return Cell::parse(number);
+}
+
+// The profiling instantiation reports every instruction, call and return
+// to the profiler, the budgeted one stops after budget instructions or
+// before it would wait for input. Otherwise those checks are compiled out.
+template<bool PROFILING, bool BUDGETED>
+Status Interpreter::interpretSwitch(unsigned long long budget) {
+    unsigned pc = this->pc, size = p.size();
+    unsigned long long count = 0;
+
+    try {
+        checkDepth(pc);
+        while(pc < size) {
+            if(BUDGETED && count == budget) {
+                this->pc = pc;
+                executed += count;
+                return YIELDED;
+            }
+            if(PROFILING) {
+                profiler->count(pc);
+            }
+            const Instruction &in = p[pc++];
+            count++;
+            switch(in.op) {
+                // Stack manipulations
+                case PUSH: {
+                    stack.push(in.arg);
+                    break;
+                }
+                case DUP: {
+                    stack.push(stack.top());
+                    break;
+                }
+                case COPY: {
+                    stack.push(stack.peek(in.arg.toLong()));
+                    break;
+                }
+                case SWAP: {
+                    stack.swap();
+                    break;
+                }
+                case DISCARD: {
+                    stack.pop();
+                    break;
+                }
+                case SLIDE: {
+                    stack.slide(in.arg.toLong());
+                    break;
+                }
+
+                // Arithmetic
+                case ADD: {
+                    Cell a = stack.pop();
+                    stack.top() = stack.top() + a;
+                    break;
+                }
+                case SUB: {
+                    Cell a = stack.pop();
+                    stack.top() = stack.top() - a;
+                    break;
+                }
+                case MUL: {
+                    Cell a = stack.pop();
+                    stack.top() = stack.top() * a;
+                    break;
+                }
+                case DIV: {
+                    Cell a = stack.pop();
+                    stack.top() = stack.top() / a;
+                    break;
+                }
+                case MOD: {
+                    Cell a = stack.pop();
+                    stack.top() = stack.top() % a;
+                    break;
+                }
+
+                // Heap access
+                case STORE: {
+                    Cell value = stack.pop();
+                    heap.store(stack.pop().toLong(), value);
+                    checkDepth(pc);
+                    break;
+                }
+                case RETRIEVE: {
+                    stack.top() = heap.load(stack.top().toLong());
+                    break;
+                }
+
+                // Flow control
+                case MARK: { // Labels have been resolved by the Linker
+                    checkDepth(pc); // Entering the block after the label
+                    break;
+                }
+                case CALL: {
+                    if(memoizer != NULL && memoizer->call(in.target, stack, callStack.size())) {
+                        checkDepth(pc); // The results are on the stack, as if it returned
+                        break;
+                    }
+                    pushReturn(pc); // Return to the instruction after the CALL
+                    pc = in.target;
+                    if(PROFILING) {
+                        profiler->enter(pc);
                     }
+                    checkDepth(pc);
+                    break;
+                }
+                case JUMP: {
+                    pc = in.target;
+                    checkDepth(pc);
+                    break;
                 }
-                heap.push_back(value);
-                break;
-            }
-            case RETRIEVE: {
-                int size = heap.size();
-                int address = stack.front();
-                stack.pop_front();
-                if((size < address) || (address < 0)) {
-                    throw OutOfBoundsException();
-                } else {
-                    stack.push_front(heap[address]);
-                }
-                break;
-            }
-
-            // Flow control
-            case MARK: {
-                int label = p[++pc];
-                labels.insert(pair<int, unsigned>(label, pc + 1)); // Go to next instruction after label
-                break;
-            }
-            case CALL: { // Not sure what the difference is between CALL and JUMP. I think this CALL function should actually execute a function...
-                int label = p[++pc];
-                auto pair = labels.find(label);
-                if(pair == labels.end()) { // Is this correct? Probably fetches last item, which is not what we want...
-                    throw LabelNotFoundException();
-                }
-                callStack.push_back(pc);
-                pc = pair->second; // go to the instruction at the found program counter
-                break;
-            }
-            case JUMP: {
-                int label = p[++pc];
-                auto pair = labels.find(label);
-                if(pair == labels.end()) { // Is this correct? Probably fetches last item, which is not what we want...
-                    throw LabelNotFoundException();
-                }
-                /// callStack.push_back(pc); <- isn't necessary, because
-		// jumps are used for loops, not for subroutines
-                pc = pair->second;
-                break;
-            }
-            case JUMPZERO: {
-                if(stack.front() == 0) {
-                    int label = p[++pc];
-                    auto pair = labels.find(label);
-                    if(pair == labels.end()) { // Is this correct? Probably fetches last item, which is not what we want...
-                        throw LabelNotFoundException();
+                case JUMPZERO: {
+                    if(stack.pop().isZero()) {
+                        pc = in.target;
                     }
-                    // callStack.push_back(pc); <- same comment as above
-                    pc = pair->second;
+                    checkDepth(pc);
+                    break;
                 }
-                break;
-            }
-            case JUMPNEG: {
-                if(stack.front() < 0) {
-                    int label = p[++pc];
-                    auto pair = labels.find(label);
-                    if(pair == labels.end()) { // Is this correct? Probably fetches last item, which is not what we want...
-                        throw LabelNotFoundException();
+                case JUMPNEG: {
+                    if(stack.pop().isNegative()) {
+                        pc = in.target;
+                    }
+                    checkDepth(pc);
+                    break;
+                }
+                case ENDSUB: {
+                    if(callStack.empty()) {
+                        throw ReturnWithoutCallException();
+                    }
+                    if(memoizer != NULL) {
+                        memoizer->leave(stack, callStack.size());
+                    }
+                    pc = callStack.back();
+                    callStack.pop_back();
+                    if(PROFILING) {
+                        profiler->leave();
+                    }
+                    checkDepth(pc);
+                    break;
+                }
+                case ENDPROG: {
+                    this->pc = pc;
+                    executed += count;
+                    return FINISHED; // this is officially the end of the interpreter session
+                }
+
+                // I/O operations
+                case WRITEC: {
+                    writeChar(stack.pop());
+                    checkDepth(pc);
+                    break;
+                }
+                case WRITEN: {
+                    writeNumber(stack.pop());
+                    checkDepth(pc);
+                    break;
+                }
+                case READC: {
+                    if(BUDGETED && !console.inputReady(false)) {
+                        this->pc = pc - 1; // Read again when resumed
+                        executed += count - 1;
+                        return BLOCKED;
+                    }
+                    heap.store(stack.pop().toLong(), readChar());
+                    checkDepth(pc);
+                    break;
+                }
+                case READN: {
+                    if(BUDGETED && !console.inputReady(true)) {
+                        this->pc = pc - 1;
+                        executed += count - 1;
+                        return BLOCKED;
+                    }
+                    heap.store(stack.pop().toLong(), readNumber());
+                    checkDepth(pc);
+                    break;
+                }
+
+                // Superinstructions
+                case PUSHADD: {
+                    stack.top() = stack.top() + in.arg;
+                    break;
+                }
+                case PUSHSUB: {
+                    stack.top() = stack.top() - in.arg;
+                    break;
+                }
+                case PUSHMUL: {
+                    stack.top() = stack.top() * in.arg;
+                    break;
+                }
+                case PUSHRETRIEVE: {
+                    stack.push(heap.load(in.arg.toLong()));
+                    break;
+                }
+                case PUSHSTORE: {
+                    heap.store(in.arg.toLong(), stack.pop());
+                    checkDepth(pc);
+                    break;
+                }
+                case PUSHWRITEC: {
+                    writeChar(in.arg);
+                    checkDepth(pc);
+                    break;
+                }
+                case DUPJUMPZERO: {
+                    if(stack.top().isZero()) {
+                        pc = in.target;
+                    }
+                    checkDepth(pc);
+                    break;
+                }
+                case DUPJUMPNEG: {
+                    if(stack.top().isNegative()) {
+                        pc = in.target;
+                    }
+                    checkDepth(pc);
+                    break;
+                }
+
+                // Loop idioms
+                case WRITESTRING: case FILLHEAP: case COPYHEAP: {
+                    if(loopIdiom(pc - 1)) {
+                        pc = in.target;
                     }
-                    // callStack.push_back(pc); <- same comment as above
-                    pc = pair->second;
-                }
-                break;
-            }
-            case ENDSUB: {
-                pc = callStack.back();
-                callStack.pop_back();
-                break;
-            }
-            case ENDPROG: {
-                cout << endl << endl << "Press the Enter key to exit..." << endl;
-                cin.ignore();
-                exit(0);
-	        return; // this is officially the end of the interpreter session
-            }
-
-            // I/O operations
-            case WRITEC: {
-                cout << (char)stack.front() << endl;
-                stack.pop_front();
-                break;
-            }
-            case WRITEN: {
-                cout << stack.front() << endl;
-                stack.pop_front();
-                break;
-            }
-            case READC: {
-                char character;
-                cin >> character;
-                heap.push_back(character);
-                break;
-            }
-            case READN: {
-                int number;
-                cin >> number;
-                heap.push_back(number);
-                break;
-            }
-            default:
-                throw InstructionNotFoundException();
+                    checkDepth(pc);
+                    break;
+                }
+                default:
+                    throw InstructionNotFoundException();
+            }
+        }
+    } catch(...) {
+        executed += count; // Up to and including the one that failed
+        throw;
+    }
+    this->pc = pc;
+    executed += count;
+    return FINISHED;
+}
+
+#if defined(__GNUC__)
+// Direct-threaded engine. Every instruction is translated to the address of
+// its handler before execution starts, and each handler jumps straight to
+// the handler of the next instruction. This replaces the single indirect
+// branch of the switch with one per handler, which predicts much better.
+void Interpreter::interpretThreaded() {
+    static const void *handlers[] = {
+        &&do_push, &&do_dup, &&do_copy, &&do_swap, &&do_discard, &&do_slide,
+        &&do_add, &&do_sub, &&do_mul, &&do_div, &&do_mod,
+        &&do_store, &&do_retrieve,
+        &&do_mark, &&do_call, &&do_jump, &&do_jumpzero, &&do_jumpneg, &&do_endsub, &&do_endprog,
+        &&do_writec, &&do_writen, &&do_readc, &&do_readn,
+        &&do_pushadd, &&do_pushsub, &&do_pushmul,
+        &&do_pushretrieve, &&do_pushstore, &&do_pushwritec,
+        &&do_dupjumpzero, &&do_dupjumpneg,
+        &&do_idiom, &&do_idiom, &&do_idiom
+    };
+    unsigned size = p.size();
+    unsigned long long count = 0;
+
+    // Resolve the handlers up front; running off the end behaves like ENDPROG
+    vector<const void *> code(size + 1);
+    for(unsigned k = 0; k < size; k++) {
+        code[k] = handlers[p[k].op];
+    }
+    code[size] = &&do_endprog;
+
+    unsigned pc = this->pc;
+    const Instruction *in;
+
+    #define DISPATCH() do { in = &p[pc]; count++; goto *code[pc++]; } while(0)
+
+    try {
+        checkDepth(pc);
+        DISPATCH();
+
+        // Stack manipulations
+        do_push:
+            stack.push(in->arg);
+            DISPATCH();
+        do_dup:
+            stack.push(stack.top());
+            DISPATCH();
+        do_copy:
+            stack.push(stack.peek(in->arg.toLong()));
+            DISPATCH();
+        do_swap:
+            stack.swap();
+            DISPATCH();
+        do_discard:
+            stack.pop();
+            DISPATCH();
+        do_slide:
+            stack.slide(in->arg.toLong());
+            DISPATCH();
+
+        // Arithmetic
+        do_add: {
+            Cell a = stack.pop();
+            stack.top() = stack.top() + a;
+            DISPATCH();
+        }
+        do_sub: {
+            Cell a = stack.pop();
+            stack.top() = stack.top() - a;
+            DISPATCH();
+        }
+        do_mul: {
+            Cell a = stack.pop();
+            stack.top() = stack.top() * a;
+            DISPATCH();
+        }
+        do_div: {
+            Cell a = stack.pop();
+            stack.top() = stack.top() / a;
+            DISPATCH();
+        }
+        do_mod: {
+            Cell a = stack.pop();
+            stack.top() = stack.top() % a;
+            DISPATCH();
         }
+
+        // Heap access
+        do_store: {
+            Cell value = stack.pop();
+            heap.store(stack.pop().toLong(), value);
+            checkDepth(pc);
+            DISPATCH();
+        }
+        do_retrieve:
+            stack.top() = heap.load(stack.top().toLong());
+            DISPATCH();
+
+        // Flow control
+        do_mark:
+            checkDepth(pc);
+            DISPATCH();
+        do_call:
+            pushReturn(pc);
+            pc = in->target;
+            checkDepth(pc);
+            DISPATCH();
+        do_jump:
+            pc = in->target;
+            checkDepth(pc);
+            DISPATCH();
+        do_jumpzero:
+            if(stack.pop().isZero()) {
+                pc = in->target;
+            }
+            checkDepth(pc);
+            DISPATCH();
+        do_jumpneg:
+            if(stack.pop().isNegative()) {
+                pc = in->target;
+            }
+            checkDepth(pc);
+            DISPATCH();
+        do_endsub:
+            if(callStack.empty()) {
+                throw ReturnWithoutCallException();
+            }
+            pc = callStack.back();
+            callStack.pop_back();
+            checkDepth(pc);
+            DISPATCH();
+        do_endprog:
+            executed += count;
+            return;
+
+        // I/O operations
+        do_writec:
+            writeChar(stack.pop());
+            checkDepth(pc);
+            DISPATCH();
+        do_writen:
+            writeNumber(stack.pop());
+            checkDepth(pc);
+            DISPATCH();
+        do_readc:
+            heap.store(stack.pop().toLong(), readChar());
+            checkDepth(pc);
+            DISPATCH();
+        do_readn:
+            heap.store(stack.pop().toLong(), readNumber());
+            checkDepth(pc);
+            DISPATCH();
+
+        // Superinstructions
+        do_pushadd:
+            stack.top() = stack.top() + in->arg;
+            DISPATCH();
+        do_pushsub:
+            stack.top() = stack.top() - in->arg;
+            DISPATCH();
+        do_pushmul:
+            stack.top() = stack.top() * in->arg;
+            DISPATCH();
+        do_pushretrieve:
+            stack.push(heap.load(in->arg.toLong()));
+            DISPATCH();
+        do_pushstore:
+            heap.store(in->arg.toLong(), stack.pop());
+            checkDepth(pc);
+            DISPATCH();
+        do_pushwritec:
+            writeChar(in->arg);
+            checkDepth(pc);
+            DISPATCH();
+        do_dupjumpzero:
+            if(stack.top().isZero()) {
+                pc = in->target;
+            }
+            checkDepth(pc);
+            DISPATCH();
+        do_dupjumpneg:
+            if(stack.top().isNegative()) {
+                pc = in->target;
+            }
+            checkDepth(pc);
+            DISPATCH();
+
+        // Loop idioms
+        do_idiom:
+            if(loopIdiom(pc - 1)) {
+                pc = in->target;
+            }
+            checkDepth(pc);
+            DISPATCH();
+    } catch(...) {
+        executed += count; // Up to and including the one that failed
+        throw;
+    }
+
+    #undef DISPATCH
+}
+
+// Direct-threaded engine that keeps the top one or two values of the stack
+// in the locals t (top) and s (below it) instead of the ValueStack. Every
+// handler exists once for each number of cached values, 0, 1 or 2, and
+// knows how many it leaves behind, so it dispatches through the code of
+// that state. Arithmetic on two cached values doesn't touch memory at all.
+// The instructions that aren't worth specializing spill the cache first.
+void Interpreter::interpretCached() {
+    static const void *handlers[3][COPYHEAP + 1] = {{
+        &&push_0, &&dup_0, &&copy_0, &&swap_0, &&discard_0, &&slide_0,
+        &&add_0, &&sub_0, &&mul_0, &&div_0, &&mod_0,
+        &&store_0, &&retrieve_0,
+        &&mark_0, &&call_0, &&jump_0, &&jumpzero_0, &&jumpneg_0, &&endsub_0, &&endprog_0,
+        &&writec_0, &&writen_0, &&readc_0, &&readn_0,
+        &&pushadd_0, &&pushsub_0, &&pushmul_0,
+        &&pushretrieve_0, &&pushstore_0, &&pushwritec_0,
+        &&dupjumpzero_0, &&dupjumpneg_0,
+        &&idiom_0, &&idiom_0, &&idiom_0
+    }, {
+        &&push_1, &&dup_1, &&copy_1, &&swap_1, &&discard_1, &&slide_1,
+        &&add_1, &&sub_1, &&mul_1, &&div_1, &&mod_1,
+        &&store_1, &&retrieve_1,
+        &&mark_1, &&call_1, &&jump_1, &&jumpzero_1, &&jumpneg_1, &&endsub_1, &&endprog_1,
+        &&writec_1, &&writen_1, &&readc_1, &&readn_1,
+        &&pushadd_1, &&pushsub_1, &&pushmul_1,
+        &&pushretrieve_1, &&pushstore_1, &&pushwritec_1,
+        &&dupjumpzero_1, &&dupjumpneg_1,
+        &&idiom_1, &&idiom_1, &&idiom_1
+    }, {
+        &&push_2, &&dup_2, &&copy_2, &&swap_2, &&discard_2, &&slide_2,
+        &&add_2, &&sub_2, &&mul_2, &&div_2, &&mod_2,
+        &&store_2, &&retrieve_2,
+        &&mark_2, &&call_2, &&jump_2, &&jumpzero_2, &&jumpneg_2, &&endsub_2, &&endprog_2,
+        &&writec_2, &&writen_2, &&readc_2, &&readn_2,
+        &&pushadd_2, &&pushsub_2, &&pushmul_2,
+        &&pushretrieve_2, &&pushstore_2, &&pushwritec_2,
+        &&dupjumpzero_2, &&dupjumpneg_2,
+        &&idiom_2, &&idiom_2, &&idiom_2
+    }};
+    unsigned size = p.size();
+    unsigned long long count = 0;
+
+    // The handlers of every instruction in every state; running off the end
+    // behaves like ENDPROG
+    vector<const void *> code(3 * (size + 1));
+    const void **code0 = &code[0], **code1 = &code[size + 1], **code2 = &code[2 * (size + 1)];
+    for(unsigned k = 0; k < size; k++) {
+        code0[k] = handlers[0][p[k].op];
+        code1[k] = handlers[1][p[k].op];
+        code2[k] = handlers[2][p[k].op];
+    }
+    code0[size] = &&endprog_0;
+    code1[size] = &&endprog_1;
+    code2[size] = &&endprog_2;
+
+    unsigned pc = this->pc;
+    const Instruction *in;
+    Cell s, t;
+
+    #define NEXT(state) do { in = &p[pc]; count++; goto *code##state[pc++]; } while(0)
+    #define CHECK(state) do { if(stack.size() + state < depthChecks[pc]) throw StackUnderflowException(); } while(0)
+
+    // Instructions that leave the stack alone keep the state
+    #define PRESERVING(state) \
+        mark_##state: \
+            CHECK(state); \
+            NEXT(state); \
+        call_##state: \
+            pushReturn(pc); \
+            pc = in->target; \
+            CHECK(state); \
+            NEXT(state); \
+        jump_##state: \
+            pc = in->target; \
+            CHECK(state); \
+            NEXT(state); \
+        endsub_##state: \
+            if(callStack.empty()) { \
+                throw ReturnWithoutCallException(); \
+            } \
+            pc = callStack.back(); \
+            callStack.pop_back(); \
+            CHECK(state); \
+            NEXT(state); \
+        pushwritec_##state: \
+            writeChar(in->arg); \
+            CHECK(state); \
+            NEXT(state);
+
+    // Instructions that only run with nothing cached
+    #define SPILLING(name) \
+        name##_1: \
+            stack.push(std::move(t)); \
+            goto name##_0; \
+        name##_2: \
+            stack.push(std::move(s)); \
+            stack.push(std::move(t)); \
+            goto name##_0;
+
+    #define PUSHING(name, value) \
+        name##_0: \
+            t = value; \
+            NEXT(1); \
+        name##_1: \
+            s = std::move(t); \
+            t = value; \
+            NEXT(2); \
+        name##_2: \
+            stack.push(std::move(s)); \
+            s = std::move(t); \
+            t = value; \
+            NEXT(2);
+
+    // Pops the top and passes it to the action as value; all of them are
+    // stores or output, which end a block
+    #define CONSUMING(name, action) \
+        name##_0: { \
+            Cell value = stack.pop(); \
+            action; \
+            CHECK(0); \
+            NEXT(0); \
+        } \
+        name##_1: { \
+            const Cell &value = t; \
+            action; \
+            CHECK(0); \
+            NEXT(0); \
+        } \
+        name##_2: { \
+            const Cell &value = t; \
+            action; \
+            t = std::move(s); \
+            CHECK(1); \
+            NEXT(1); \
+        }
+
+    #define BINARY(name, operation) \
+        name##_0: \
+            t = stack.pop(); \
+            s = stack.pop(); \
+            t = s operation t; \
+            NEXT(1); \
+        name##_1: \
+            s = stack.pop(); \
+            t = s operation t; \
+            NEXT(1); \
+        name##_2: \
+            t = s operation t; \
+            NEXT(1);
+
+    #define IMMEDIATE(name, operation) \
+        name##_0: \
+            t = stack.pop(); \
+            t = t operation in->arg; \
+            NEXT(1); \
+        name##_1: \
+            t = t operation in->arg; \
+            NEXT(1); \
+        name##_2: \
+            t = t operation in->arg; \
+            NEXT(2);
+
+    // Branches that pop the value they test, and those that keep it
+    #define BRANCH(name, test) \
+        name##_0: \
+            if(stack.pop().test()) { \
+                pc = in->target; \
+            } \
+            CHECK(0); \
+            NEXT(0); \
+        name##_1: \
+            if(t.test()) { \
+                pc = in->target; \
+            } \
+            CHECK(0); \
+            NEXT(0); \
+        name##_2: \
+            if(t.test()) { \
+                pc = in->target; \
+            } \
+            t = std::move(s); \
+            CHECK(1); \
+            NEXT(1);
+
+    #define DUPBRANCH(name, test) \
+        name##_0: \
+            t = stack.pop(); \
+            if(t.test()) { \
+                pc = in->target; \
+            } \
+            CHECK(1); \
+            NEXT(1); \
+        name##_1: \
+            if(t.test()) { \
+                pc = in->target; \
+            } \
+            CHECK(1); \
+            NEXT(1); \
+        name##_2: \
+            if(t.test()) { \
+                pc = in->target; \
+            } \
+            CHECK(2); \
+            NEXT(2);
+
+    try {
+        checkDepth(pc);
+        NEXT(0);
+
+        // Stack manipulations
+        PUSHING(push, in->arg)
+        dup_0:
+            t = stack.pop();
+            s = t;
+            NEXT(2);
+        dup_1:
+            s = t;
+            NEXT(2);
+        dup_2:
+            stack.push(std::move(s));
+            s = t;
+            NEXT(2);
+        swap_0:
+            s = stack.pop();
+            t = stack.pop();
+            NEXT(2);
+        swap_1:
+            s = stack.pop();
+            swap(s, t);
+            NEXT(2);
+        swap_2:
+            swap(s, t);
+            NEXT(2);
+        discard_0:
+            stack.pop();
+            NEXT(0);
+        discard_1:
+            NEXT(0);
+        discard_2:
+            t = std::move(s);
+            NEXT(1);
+        copy_0:
+            stack.push(stack.peek(in->arg.toLong()));
+            NEXT(0);
+        SPILLING(copy)
+        slide_0:
+            stack.slide(in->arg.toLong());
+            NEXT(0);
+        SPILLING(slide)
+
+        // Arithmetic
+        BINARY(add, +)
+        BINARY(sub, -)
+        BINARY(mul, *)
+        BINARY(div, /)
+        BINARY(mod, %)
+
+        // Heap access
+        store_0:
+            t = stack.pop();
+            s = stack.pop();
+            heap.store(s.toLong(), t);
+            CHECK(0);
+            NEXT(0);
+        store_1:
+            s = stack.pop();
+            heap.store(s.toLong(), t);
+            CHECK(0);
+            NEXT(0);
+        store_2:
+            heap.store(s.toLong(), t);
+            CHECK(0);
+            NEXT(0);
+        retrieve_0:
+            t = stack.pop();
+            t = heap.load(t.toLong());
+            NEXT(1);
+        retrieve_1:
+            t = heap.load(t.toLong());
+            NEXT(1);
+        retrieve_2:
+            t = heap.load(t.toLong());
+            NEXT(2);
+
+        // Flow control
+        PRESERVING(0)
+        PRESERVING(1)
+        PRESERVING(2)
+        BRANCH(jumpzero, isZero)
+        BRANCH(jumpneg, isNegative)
+        endprog_0:
+            executed += count;
+            return;
+        SPILLING(endprog)
+
+        // I/O operations
+        CONSUMING(writec, writeChar(value))
+        CONSUMING(writen, writeNumber(value))
+        readc_0:
+            heap.store(stack.pop().toLong(), readChar());
+            CHECK(0);
+            NEXT(0);
+        SPILLING(readc)
+        readn_0:
+            heap.store(stack.pop().toLong(), readNumber());
+            CHECK(0);
+            NEXT(0);
+        SPILLING(readn)
+
+        // Superinstructions
+        IMMEDIATE(pushadd, +)
+        IMMEDIATE(pushsub, -)
+        IMMEDIATE(pushmul, *)
+        PUSHING(pushretrieve, heap.load(in->arg.toLong()))
+        CONSUMING(pushstore, heap.store(in->arg.toLong(), value))
+        DUPBRANCH(dupjumpzero, isZero)
+        DUPBRANCH(dupjumpneg, isNegative)
+
+        // Loop idioms
+        idiom_0:
+            if(loopIdiom(pc - 1)) {
+                pc = in->target;
+            }
+            CHECK(0);
+            NEXT(0);
+        SPILLING(idiom)
+    } catch(...) {
+        executed += count; // Up to and including the one that failed
+        throw;
     }
+
+    #undef NEXT
+    #undef CHECK
+    #undef PRESERVING
+    #undef SPILLING
+    #undef PUSHING
+    #undef CONSUMING
+    #undef BINARY
+    #undef IMMEDIATE
+    #undef BRANCH
+    #undef DUPBRANCH
+}
+#else
+// Labels-as-values is a GNU extension, so other compilers use the switch.
+void Interpreter::interpretThreaded() {
+    interpretSwitch<false, false>();
+}
+
+void Interpreter::interpretCached() {
+    interpretSwitch<false, false>();
 }
+#endif
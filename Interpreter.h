@@ -1,24 +1,104 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
-#include <list>
-#include <map>
 #include <vector>
+#include <memory>
 #include <iostream>
+#include <exception>
 #include "Types.h"
+#include "ValueStack.h"
+#include "Heap.h"
+#include "Console.h"
+#include "Profiler.h"
+#include "Memoizer.h"
+#include "Verifier.h"
 #include "Exceptions.h"
 
+// The execution engines interpret() can dispatch with
+enum Engine {
+    SWITCH_ENGINE, // A plain switch over the opcode, portable fallback
+    THREADED_ENGINE, // Direct-threaded code using GCC's labels-as-values
+    CACHED_ENGINE, // Direct-threaded code keeping the top of the stack in locals
+    JIT_ENGINE // Native x86-64 code, falls back to SWITCH_ENGINE if needed
+};
+
+// Where run() left the program
+enum Status {
+    YIELDED, // The budget ran out, the next run() continues from there
+    BLOCKED, // Waiting for input, run() again once there is more
+    FINISHED, // ENDPROG or the end of the program
+    FAILED // Stopped by a runtime error, see error()
+};
+
 class Interpreter {
+    friend class Jit; // Uses the heap and the I/O helpers at runtime
+    friend class Checkpoint; // Saves and restores all of the state
+
     public:
-        Interpreter(Program);
-        void interpret();
+        static const size_t MAX_CALL_DEPTH = 8 * 1024 * 1024; // Also for the JIT
+
+        Interpreter(Program, size_t = ValueStack::DEFAULT_CAPACITY, size_t = Heap::DEFAULT_LIMIT);
+        Interpreter(std::shared_ptr<const VerifiedProgram>, size_t = ValueStack::DEFAULT_CAPACITY,
+                    size_t = Heap::DEFAULT_LIMIT); // Shared, not copied
+
+        static std::shared_ptr<const VerifiedProgram> verify(Program);
+        void interpret(Engine = SWITCH_ENGINE);
+
+        // Executes up to the given number of instructions on the switch
+        // engine and returns, keeping all state for the next call. Errors
+        // are caught and kept instead of thrown.
+        Status run(unsigned long long);
+        Status status() const;
+        std::exception_ptr error() const;
+
+        void redirect(Source &, Sink &); // Standard input and output by default
+        unsigned long long instructionCount() const;
+        void profile(Profiler *); // Runs on the switch engine while profiling
+        void memoize(Memoizer *); // Likewise
 
     private:
-        Program p; // Contains instructions from the Whitespace source
-        std::vector<int> heap;
-        std::list<int> stack; // To store values
-        std::vector<int> callStack; // To remember where to return to
-        std::map<int, unsigned> labels; // Lookup table for labels
+        std::shared_ptr<const VerifiedProgram> verified;
+        const Program &p; // Contains instructions from the Whitespace source
+        const std::vector<unsigned> &depthChecks; // Per pc, from the Verifier
+        Heap heap;
+        ValueStack stack; // To store values
+        std::vector<unsigned> callStack; // To remember where to return to
+        unsigned pc; // Where the engines start, moved on if the JIT bails out
+        unsigned long long executed; // Number of dispatched instructions
+        Console console;
+        Profiler *profiler; // NULL unless profiling
+        Memoizer *memoizer; // NULL unless memoizing
+        Status state; // Of run()
+        std::exception_ptr failure;
+
+        void execute(Engine);
+        template<bool PROFILING, bool BUDGETED> Status interpretSwitch(unsigned long long = 0);
+        void interpretThreaded();
+        void interpretCached();
+
+        // Called where a block may start: after branches, calls and labels
+        void checkDepth(unsigned pc) {
+            if(stack.size() < depthChecks[pc]) {
+                throw StackUnderflowException();
+            }
+        }
+
+        // On CALL, so runaway recursion stops before memory runs out
+        void pushReturn(unsigned pc) {
+            if(callStack.size() == MAX_CALL_DEPTH) {
+                throw CallStackOverflowException();
+            }
+            callStack.push_back(pc);
+        }
+
+        // Runs the loop after the idiom at pc to its end at once, and returns
+        // true if it did. Otherwise the loop runs as it is.
+        bool loopIdiom(unsigned);
+
+        void writeChar(const Cell &);
+        void writeNumber(const Cell &);
+        long readChar();
+        Cell readNumber();
 };
 
 #endif
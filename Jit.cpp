@@ -0,0 +1,674 @@
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+
+#include "Jit.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+// Register assignment of the generated code:
+//   rbx  JitContext
+//   r12  value stack pointer (element below the top)
+//   r13  heap page directory
+//   r14  top of the stack
+//   r15  heap page directory size
+//   rbp  scratch, saves rsp around helper calls
+// All of them are callee-saved, so helper calls don't disturb them.
+// Values on the stacks and in the heap are tagged words (see Cell.h), so
+// addresses and divisors are shifted right by one before they're used.
+
+static_assert(sizeof(Cell) == sizeof(long), "The generated code assumes a Cell is one word");
+
+// The limits match those of the other engines: a CALL takes one return address
+static const size_t VALUE_STACK_GUARD = 16; // Cells below the bottom of the stack
+static const size_t VALUE_STACK_CELLS = ValueStack::LIMIT + VALUE_STACK_GUARD;
+static const size_t NATIVE_STACK_RESERVE = 256 * 1024; // Room for the helpers
+static const size_t NATIVE_STACK_SIZE = Interpreter::MAX_CALL_DEPTH * sizeof(void *) + NATIVE_STACK_RESERVE;
+
+#define CONTEXT_OFFSET(field) ((int)offsetof(JitContext, field))
+
+static void *allocate(size_t size) {
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return (memory == MAP_FAILED ? NULL : memory);
+}
+
+static bool fitsInt32(long value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+Jit::Jit(Interpreter &interpreter) : interpreter(interpreter) {
+    executable = NULL;
+    executableSize = 0;
+    valueStackSize = VALUE_STACK_CELLS * sizeof(long);
+    valueStack = (long *)allocate(valueStackSize);
+    nativeStackSize = NATIVE_STACK_SIZE;
+    nativeStack = (char *)allocate(nativeStackSize);
+    memset(&context, 0, sizeof(context));
+    context.jit = this;
+}
+
+Jit::~Jit() {
+    if(executable != NULL) {
+        munmap(executable, executableSize);
+    }
+    if(valueStack != NULL) {
+        munmap(valueStack, valueStackSize);
+    }
+    if(nativeStack != NULL) {
+        munmap(nativeStack, nativeStackSize);
+    }
+}
+
+// Runtime helpers. Exceptions must not unwind through generated code, so
+// they are stored and rethrown by run() once the generated code returned.
+
+void Jit::helperStore(JitContext *context, long address, long value) {
+    try {
+        context->jit->interpreter.heap.store(address, Cell::fromBits(value));
+    } catch(...) {
+        context->jit->exception = current_exception();
+        context->error = RUNTIME_ERROR;
+    }
+    context->jit->refreshHeap();
+}
+
+long Jit::helperRetrieve(JitContext *context, long address) {
+    try {
+        return context->jit->interpreter.heap.load(address).toBits();
+    } catch(...) {
+        context->jit->exception = current_exception();
+        context->error = RUNTIME_ERROR;
+    }
+    return 0;
+}
+
+// Writing fails once the output is gone, like a closed pipe
+void Jit::helperWriteChar(JitContext *context, long value) {
+    try {
+        context->jit->interpreter.writeChar(Cell::fromBits(value));
+    } catch(...) {
+        context->jit->exception = current_exception();
+        context->error = RUNTIME_ERROR;
+    }
+}
+
+void Jit::helperWriteNumber(JitContext *context, long value) {
+    try {
+        context->jit->interpreter.writeNumber(Cell::fromBits(value));
+    } catch(...) {
+        context->jit->exception = current_exception();
+        context->error = RUNTIME_ERROR;
+    }
+}
+
+void Jit::helperReadChar(JitContext *context, long address) {
+    try {
+        context->jit->interpreter.heap.store(address, context->jit->interpreter.readChar());
+    } catch(...) {
+        context->jit->exception = current_exception();
+        context->error = RUNTIME_ERROR;
+    }
+    context->jit->refreshHeap();
+}
+
+// A number that doesn't fit in a small cell can't be handled by the
+// generated code, so the Interpreter takes over after the READN at pc.
+void Jit::helperReadNumber(JitContext *context, long address, long pc) {
+    try {
+        Cell number = context->jit->interpreter.readNumber();
+        context->jit->interpreter.heap.store(address, number);
+        if(!number.isSmall()) {
+            context->resumePc = pc + 1;
+            context->error = DEOPTIMIZE;
+        }
+    } catch(...) {
+        context->jit->exception = current_exception();
+        context->error = RUNTIME_ERROR;
+    }
+    context->jit->refreshHeap();
+}
+
+void Jit::refreshHeap() {
+    context.heapDirectory = (long *const *)interpreter.heap.directoryData();
+    context.heapPages = interpreter.heap.directorySize();
+}
+
+// Rebuilds the Interpreter's value stack and call stack from the state the
+// generated code left behind, so it can continue at resumePc.
+void Jit::deoptimize() {
+    long *bottom = valueStack + VALUE_STACK_GUARD; // Holds the initial dummy top
+    for(long *cell = bottom + 1; cell <= context.sp; cell++) {
+        interpreter.stack.push(Cell::fromBits(*cell));
+    }
+    if(context.sp >= bottom) {
+        interpreter.stack.push(Cell::fromBits(context.tos));
+    }
+
+    // Between the exit and the entry the native stack only holds the return
+    // addresses of CALLs, the outermost one at the highest address.
+    void **outermost = (void **)context.entryRsp - 1;
+    for(void **frame = outermost; frame >= (void **)context.deoptRsp; frame--) {
+        size_t offset = (char *)*frame - (char *)executable;
+        interpreter.callStack.push_back(returnPcs[offset]);
+    }
+    interpreter.pc = context.resumePc;
+}
+
+// Emitting machine code
+
+void Jit::emit(initializer_list<unsigned char> bytes) {
+    code.insert(code.end(), bytes);
+}
+
+void Jit::emit32(int value) {
+    unsigned char bytes[4];
+    memcpy(bytes, &value, 4);
+    code.insert(code.end(), bytes, bytes + 4);
+}
+
+void Jit::emit64(long value) {
+    unsigned char bytes[8];
+    memcpy(bytes, &value, 8);
+    code.insert(code.end(), bytes, bytes + 8);
+}
+
+// Emits a jmp, call or (with a 0x0F prefix) conditional jump with a rel32
+// operand that is filled in by patch(). Returns the position of the operand.
+size_t Jit::emitJump(unsigned char opcode, unsigned char condition) {
+    if(condition != 0) {
+        emit({opcode, condition});
+    } else {
+        emit({opcode});
+    }
+    size_t position = code.size();
+    emit32(0);
+    return position;
+}
+
+void Jit::patch(size_t position, size_t target) {
+    int relative = (int)(target - (position + 4));
+    memcpy(&code[position], &relative, 4);
+}
+
+void Jit::emitContextOffset(size_t offset) {
+    emit32((int)offset);
+}
+
+// Makes room for a new top of the stack by spilling the old one
+void Jit::emitPushTos(size_t overflowStub) {
+    emit({0x49, 0x83, 0xC4, 0x08}); // add r12, 8
+    emit({0x4C, 0x3B, 0xA3}); // cmp r12, [rbx + stackLimit]
+    emitContextOffset(CONTEXT_OFFSET(stackLimit));
+    patch(emitJump(0x0F, 0x87), overflowStub); // ja overflowStub
+    emit({0x4D, 0x89, 0x34, 0x24}); // mov [r12], r14
+}
+
+void Jit::emitPopTos() {
+    emit({0x4D, 0x8B, 0x34, 0x24}); // mov r14, [r12]
+    emit({0x49, 0x83, 0xEC, 0x08}); // sub r12, 8
+}
+
+// Calls a helper with the context as first argument. The native stack may
+// be misaligned inside a Whitespace subroutine, so it is realigned first.
+void Jit::emitCall(void *function) {
+    emit({0x48, 0x89, 0xDF}); // mov rdi, rbx
+    emit({0x48, 0x89, 0xE5}); // mov rbp, rsp
+    emit({0x48, 0x83, 0xE4, 0xF0}); // and rsp, -16
+    emit({0x48, 0xB8}); // mov rax, function
+    emit64((long)function);
+    emit({0xFF, 0xD0}); // call rax
+    emit({0x48, 0x89, 0xEC}); // mov rsp, rbp
+}
+
+void Jit::emitErrorCheck(size_t exitStub) {
+    emit({0x83, 0xBB}); // cmp dword [rbx + error], 0
+    emitContextOffset(CONTEXT_OFFSET(error));
+    emit({0x00});
+    patch(emitJump(0x0F, 0x85), exitStub); // jne exitStub
+}
+
+void Jit::emitReloadHeap() {
+    emit({0x4C, 0x8B, 0xAB}); // mov r13, [rbx + heapDirectory]
+    emitContextOffset(CONTEXT_OFFSET(heapDirectory));
+    emit({0x4C, 0x8B, 0xBB}); // mov r15, [rbx + heapPages]
+    emitContextOffset(CONTEXT_OFFSET(heapPages));
+}
+
+// Looks up the page of the address in rax in the directory, leaving the
+// page in rdx and the offset within the page in rax. The two returned jump
+// operands are taken when the page is not in the directory, which includes
+// negative addresses (huge after the shift), or hasn't been allocated.
+pair<size_t, size_t> Jit::emitPageLookup() {
+    emit({0x48, 0x89, 0xC2}); // mov rdx, rax
+    emit({0x48, 0xC1, 0xEA, (unsigned char)Heap::PAGE_BITS}); // shr rdx, PAGE_BITS
+    emit({0x4C, 0x39, 0xFA}); // cmp rdx, r15
+    size_t outside = emitJump(0x0F, 0x83); // jae slow
+    emit({0x49, 0x8B, 0x54, 0xD5, 0x00}); // mov rdx, [r13 + rdx * 8]
+    emit({0x48, 0x85, 0xD2}); // test rdx, rdx
+    size_t untouched = emitJump(0x0F, 0x84); // jz slow
+    emit({0x48, 0x25}); // and rax, PAGE_SIZE - 1
+    emit32((int)(Heap::PAGE_SIZE - 1));
+    return make_pair(outside, untouched);
+}
+
+// Points both jumps of a page lookup at the slow path
+void Jit::patchPageLookup(const pair<size_t, size_t> &lookup, size_t target) {
+    patch(lookup.first, target);
+    patch(lookup.second, target);
+}
+
+// Leaves the generated code through the deopt stub of pc. The condition is
+// that of a jcc, or 0 to always deoptimize.
+void Jit::emitDeoptimize(unsigned char condition, unsigned pc) {
+    if(condition != 0) {
+        deoptimizations.push_back(make_pair(emitJump(0x0F, condition), pc));
+    } else {
+        deoptimizations.push_back(make_pair(emitJump(0xE9), pc));
+    }
+}
+
+// Loads the heap cell at the address in rax into rax. Untouched, distant and
+// negative addresses go through the helper.
+void Jit::emitRetrieve(size_t exitStub) {
+    pair<size_t, size_t> lookup = emitPageLookup();
+    emit({0x48, 0x8B, 0x04, 0xC2}); // mov rax, [rdx + rax * 8]
+    size_t done = emitJump(0xE9); // jmp done
+    patchPageLookup(lookup, code.size());
+    emit({0x48, 0x89, 0xC6}); // mov rsi, rax
+    emitCall((void *)&Jit::helperRetrieve);
+    emitErrorCheck(exitStub);
+    patch(done, code.size());
+}
+
+// Stores r14 at the heap address in rax. Stores to a page that doesn't
+// exist yet go through the helper, after which the directory is reloaded.
+void Jit::emitStore(size_t exitStub) {
+    pair<size_t, size_t> lookup = emitPageLookup();
+    emit({0x4C, 0x89, 0x34, 0xC2}); // mov [rdx + rax * 8], r14
+    size_t done = emitJump(0xE9); // jmp done
+    patchPageLookup(lookup, code.size());
+    emit({0x48, 0x89, 0xC6}); // mov rsi, rax
+    emit({0x4C, 0x89, 0xF2}); // mov rdx, r14
+    emitCall((void *)&Jit::helperStore);
+    emitErrorCheck(exitStub);
+    emitReloadHeap();
+    patch(done, code.size());
+}
+
+// Applies PUSHADD, PUSHSUB or PUSHMUL with a small immediate to r14. The
+// result is computed in rax first, so r14 is intact if it overflows.
+void Jit::emitImmediate(Opcode op, long value, unsigned pc) {
+    if(op == PUSHMUL) {
+        if(fitsInt32(value)) {
+            emit({0x49, 0x69, 0xC6}); // imul rax, r14, imm32
+            emit32((int)value);
+        } else {
+            emit({0x48, 0xB8}); // mov rax, imm64
+            emit64(value);
+            emit({0x49, 0x0F, 0xAF, 0xC6}); // imul rax, r14
+        }
+    } else {
+        long tagged = Cell(value).toBits();
+        emit({0x4C, 0x89, 0xF0}); // mov rax, r14
+        if(fitsInt32(tagged)) {
+            emit({0x48, (unsigned char)(op == PUSHADD ? 0x05 : 0x2D)}); // add/sub rax, imm32
+            emit32((int)tagged);
+        } else {
+            emit({0x48, 0xB9}); // mov rcx, imm64
+            emit64(tagged);
+            emit({0x48, (unsigned char)(op == PUSHADD ? 0x01 : 0x29), 0xC8}); // add/sub rax, rcx
+        }
+    }
+    emitDeoptimize(0x80, pc); // jo
+    emit({0x49, 0x89, 0xC6}); // mov r14, rax
+}
+
+// The Verifier's check at the start of a block. With n values on the
+// stack, r12 is n - 1 cells above the bottom of the value stack.
+void Jit::emitDepthCheck(unsigned depth, size_t underflowStub) {
+    long *least = valueStack + VALUE_STACK_GUARD - 1 + min((size_t)depth, VALUE_STACK_CELLS);
+    emit({0x48, 0xB8}); // mov rax, least
+    emit64((long)least);
+    emit({0x49, 0x39, 0xC4}); // cmp r12, rax
+    patch(emitJump(0x0F, 0x82), underflowStub); // jb
+}
+
+bool Jit::compile() {
+#if !defined(__x86_64__)
+    return false;
+#endif
+    if(valueStack == NULL || nativeStack == NULL) {
+        return false;
+    }
+
+    const Program &p = interpreter.p;
+    unsigned size = p.size();
+    vector<size_t> offsets(size + 1); // Native code offset of every instruction
+    vector<pair<size_t, unsigned> > branches; // Operands to patch with a target
+    code.clear();
+    deoptimizations.clear();
+    returnPcs.clear();
+
+    // Prologue: save the callee-saved registers and switch to our own native
+    // stack, so deep Whitespace recursion can't overflow the caller's.
+    emit({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57}); // push rbx, rbp, r12-r15
+    emit({0x48, 0x89, 0xFB}); // mov rbx, rdi
+    emit({0x48, 0x89, 0xA3}); // mov [rbx + hostRsp], rsp
+    emitContextOffset(CONTEXT_OFFSET(hostRsp));
+    emit({0x48, 0x8B, 0xA3}); // mov rsp, [rbx + nativeStackTop]
+    emitContextOffset(CONTEXT_OFFSET(nativeStackTop));
+    emit({0x48, 0x89, 0xA3}); // mov [rbx + entryRsp], rsp
+    emitContextOffset(CONTEXT_OFFSET(entryRsp));
+    emit({0x4C, 0x8B, 0xA3}); // mov r12, [rbx + sp]
+    emitContextOffset(CONTEXT_OFFSET(sp));
+    emit({0x4C, 0x8B, 0xB3}); // mov r14, [rbx + tos]
+    emitContextOffset(CONTEXT_OFFSET(tos));
+    emitReloadHeap();
+    size_t start = emitJump(0xE9); // jmp start
+
+    // Exit stub: write back the value stack and return to the host
+    size_t exitStub = code.size();
+    emit({0x4C, 0x89, 0xA3}); // mov [rbx + sp], r12
+    emitContextOffset(CONTEXT_OFFSET(sp));
+    emit({0x4C, 0x89, 0xB3}); // mov [rbx + tos], r14
+    emitContextOffset(CONTEXT_OFFSET(tos));
+    emit({0x48, 0x89, 0xA3}); // mov [rbx + deoptRsp], rsp
+    emitContextOffset(CONTEXT_OFFSET(deoptRsp));
+    emit({0x48, 0x8B, 0xA3}); // mov rsp, [rbx + hostRsp]
+    emitContextOffset(CONTEXT_OFFSET(hostRsp));
+    emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B}); // pop r15-r12, rbp, rbx
+    emit({0xC3}); // ret
+
+    // Error stubs: record the error and leave through the exit stub
+    size_t errorStubs[] = {0, 0, 0, 0, 0, 0, 0};
+    for(int error = STACK_OVERFLOW; error <= DEOPTIMIZE; error++) {
+        errorStubs[error] = code.size();
+        emit({0xC7, 0x83}); // mov dword [rbx + error], error
+        emitContextOffset(CONTEXT_OFFSET(error));
+        emit32(error);
+        patch(emitJump(0xE9), exitStub);
+    }
+    size_t overflowStub = errorStubs[STACK_OVERFLOW];
+    patch(start, code.size());
+
+    for(unsigned pc = 0; pc < size; pc++) {
+        const Instruction &in = p[pc];
+        offsets[pc] = code.size();
+        if(interpreter.depthChecks[pc] > 0) {
+            emitDepthCheck(interpreter.depthChecks[pc], errorStubs[STACK_UNDERFLOW]);
+        }
+
+        // Big literals are left to the interpreter, which needs them rarely
+        if(!in.arg.isSmall()) {
+            if(in.op == COPY || in.op == SLIDE) {
+                return false;
+            }
+            if(in.op == PUSH || in.op == PUSHADD || in.op == PUSHSUB || in.op == PUSHMUL ||
+               in.op == PUSHRETRIEVE || in.op == PUSHSTORE || in.op == PUSHWRITEC) {
+                emitDeoptimize(0, pc);
+                continue;
+            }
+        }
+        long arg = in.arg.small();
+
+        switch(in.op) {
+            // Stack manipulations
+            case PUSH:
+                emitPushTos(overflowStub);
+                if(fitsInt32(in.arg.toBits())) {
+                    emit({0x49, 0xC7, 0xC6}); // mov r14, imm32
+                    emit32((int)in.arg.toBits());
+                } else {
+                    emit({0x49, 0xBE}); // mov r14, imm64
+                    emit64(in.arg.toBits());
+                }
+                break;
+            case DUP:
+                emitPushTos(overflowStub);
+                break;
+            case COPY:
+                if(arg < 0 || arg > (1 << 24)) {
+                    return false;
+                }
+                if(arg == 0) {
+                    emitPushTos(overflowStub);
+                    break;
+                }
+                emit({0x49, 0x8B, 0x84, 0x24}); // mov rax, [r12 - (n - 1) * 8]
+                emit32(-(int)(arg - 1) * 8);
+                emitPushTos(overflowStub);
+                emit({0x49, 0x89, 0xC6}); // mov r14, rax
+                break;
+            case SWAP:
+                emit({0x49, 0x8B, 0x04, 0x24}); // mov rax, [r12]
+                emit({0x4D, 0x89, 0x34, 0x24}); // mov [r12], r14
+                emit({0x49, 0x89, 0xC6}); // mov r14, rax
+                break;
+            case DISCARD:
+                emitPopTos();
+                break;
+            case SLIDE:
+                if(arg < 0 || arg > (1 << 24)) {
+                    return false;
+                }
+                emit({0x49, 0x81, 0xEC}); // sub r12, n * 8
+                emit32((int)arg * 8);
+                break;
+
+            // Arithmetic on tagged words, deoptimizing before anything
+            // changes if the result doesn't fit in a small cell
+            case ADD:
+                emit({0x49, 0x8B, 0x04, 0x24}); // mov rax, [r12]
+                emit({0x4C, 0x01, 0xF0}); // add rax, r14
+                emitDeoptimize(0x80, pc); // jo
+                emit({0x49, 0x89, 0xC6}); // mov r14, rax
+                emit({0x49, 0x83, 0xEC, 0x08}); // sub r12, 8
+                break;
+            case SUB:
+                emit({0x49, 0x8B, 0x04, 0x24}); // mov rax, [r12]
+                emit({0x4C, 0x29, 0xF0}); // sub rax, r14
+                emitDeoptimize(0x80, pc); // jo
+                emit({0x49, 0x89, 0xC6}); // mov r14, rax
+                emit({0x49, 0x83, 0xEC, 0x08}); // sub r12, 8
+                break;
+            case MUL:
+                emit({0x4C, 0x89, 0xF0}); // mov rax, r14
+                emit({0x48, 0xD1, 0xF8}); // sar rax, 1
+                emit({0x49, 0x0F, 0xAF, 0x04, 0x24}); // imul rax, [r12]
+                emitDeoptimize(0x80, pc); // jo
+                emit({0x49, 0x89, 0xC6}); // mov r14, rax
+                emit({0x49, 0x83, 0xEC, 0x08}); // sub r12, 8
+                break;
+            case DIV: case MOD:
+                // Division by zero is reported by the interpreter
+                emit({0x4D, 0x85, 0xF6}); // test r14, r14
+                emitDeoptimize(0x84, pc); // jz
+                emit({0x4C, 0x89, 0xF1}); // mov rcx, r14
+                emit({0x48, 0xD1, 0xF9}); // sar rcx, 1
+                emit({0x49, 0x8B, 0x04, 0x24}); // mov rax, [r12]
+                emit({0x48, 0xD1, 0xF8}); // sar rax, 1
+                emit({0x48, 0x99}); // cqo
+                emit({0x48, 0xF7, 0xF9}); // idiv rcx
+                if(in.op == MOD) {
+                    emit({0x48, 0x89, 0xD0}); // mov rax, rdx
+                }
+                emit({0x48, 0x01, 0xC0}); // add rax, rax
+                emitDeoptimize(0x80, pc); // jo, only for the smallest value divided by -1
+                emit({0x49, 0x89, 0xC6}); // mov r14, rax
+                emit({0x49, 0x83, 0xEC, 0x08}); // sub r12, 8
+                break;
+
+            // Heap access
+            case STORE:
+                emit({0x49, 0x8B, 0x04, 0x24}); // mov rax, [r12]
+                emit({0x48, 0xD1, 0xF8}); // sar rax, 1
+                emitStore(exitStub);
+                emit({0x4D, 0x8B, 0x74, 0x24, 0xF8}); // mov r14, [r12 - 8]
+                emit({0x49, 0x83, 0xEC, 0x10}); // sub r12, 16
+                break;
+            case RETRIEVE:
+                emit({0x4C, 0x89, 0xF0}); // mov rax, r14
+                emit({0x48, 0xD1, 0xF8}); // sar rax, 1
+                emitRetrieve(exitStub);
+                emit({0x49, 0x89, 0xC6}); // mov r14, rax
+                break;
+
+            // Flow control
+            case MARK:
+                break;
+            case CALL:
+                emit({0x48, 0x3B, 0xA3}); // cmp rsp, [rbx + rspLimit]
+                emitContextOffset(CONTEXT_OFFSET(rspLimit));
+                patch(emitJump(0x0F, 0x82), errorStubs[CALL_OVERFLOW]); // jb
+                branches.push_back(make_pair(emitJump(0xE8), in.target)); // call target
+                returnPcs[code.size()] = pc + 1;
+                break;
+            case JUMP:
+                branches.push_back(make_pair(emitJump(0xE9), in.target));
+                break;
+            case JUMPZERO: case JUMPNEG: // Tagging keeps the sign and zero
+                emit({0x4C, 0x89, 0xF0}); // mov rax, r14
+                emitPopTos();
+                emit({0x48, 0x85, 0xC0}); // test rax, rax
+                branches.push_back(make_pair(emitJump(0x0F, in.op == JUMPZERO ? 0x84 : 0x88), in.target));
+                break;
+            case ENDSUB:
+                emit({0x48, 0x3B, 0xA3}); // cmp rsp, [rbx + entryRsp]
+                emitContextOffset(CONTEXT_OFFSET(entryRsp));
+                patch(emitJump(0x0F, 0x84), errorStubs[RETURN_WITHOUT_CALL]); // je
+                emit({0xC3}); // ret
+                break;
+            case ENDPROG:
+                patch(emitJump(0xE9), exitStub);
+                break;
+
+            // I/O operations
+            case WRITEC: case WRITEN:
+                emit({0x4C, 0x89, 0xF6}); // mov rsi, r14
+                emitPopTos();
+                emitCall(in.op == WRITEC ? (void *)&Jit::helperWriteChar
+                                         : (void *)&Jit::helperWriteNumber);
+                emitErrorCheck(exitStub);
+                break;
+            case READC: case READN:
+                emit({0x4C, 0x89, 0xF6}); // mov rsi, r14
+                emit({0x48, 0xD1, 0xFE}); // sar rsi, 1
+                emitPopTos();
+                emit({0xBA}); // mov edx, pc
+                emit32((int)pc);
+                emitCall(in.op == READC ? (void *)&Jit::helperReadChar
+                                        : (void *)&Jit::helperReadNumber);
+                emitErrorCheck(exitStub);
+                emitReloadHeap();
+                break;
+
+            // Superinstructions
+            case PUSHADD: case PUSHSUB: case PUSHMUL:
+                emitImmediate(in.op, arg, pc);
+                break;
+            case PUSHRETRIEVE:
+                emitPushTos(overflowStub);
+                emit({0x48, 0xB8}); // mov rax, address
+                emit64(arg);
+                emitRetrieve(exitStub);
+                emit({0x49, 0x89, 0xC6}); // mov r14, rax
+                break;
+            case PUSHSTORE:
+                emit({0x48, 0xB8}); // mov rax, address
+                emit64(arg);
+                emitStore(exitStub);
+                emitPopTos();
+                break;
+            case PUSHWRITEC:
+                emit({0x48, 0xBE}); // mov rsi, character
+                emit64(in.arg.toBits());
+                emitCall((void *)&Jit::helperWriteChar);
+                emitErrorCheck(exitStub);
+                break;
+            case DUPJUMPZERO: case DUPJUMPNEG:
+                emit({0x4D, 0x85, 0xF6}); // test r14, r14
+                branches.push_back(make_pair(emitJump(0x0F, in.op == DUPJUMPZERO ? 0x84 : 0x88), in.target));
+                break;
+
+            // Loop idioms, the loop that follows them is compiled instead
+            case WRITESTRING: case FILLHEAP: case COPYHEAP:
+                break;
+
+            default: // Not supported, let the interpreter run this program
+                return false;
+        }
+    }
+    // Running off the end of the program ends it, like ENDPROG
+    offsets[size] = code.size();
+    patch(emitJump(0xE9), exitStub);
+
+    for(unsigned k = 0; k < branches.size(); k++) {
+        patch(branches[k].first, offsets[branches[k].second]);
+    }
+
+    // Deopt stubs, one per instruction that needs one: record where the
+    // interpreter has to continue and leave
+    map<unsigned, size_t> deoptStubs;
+    for(unsigned k = 0; k < deoptimizations.size(); k++) {
+        unsigned pc = deoptimizations[k].second;
+        if(deoptStubs.find(pc) == deoptStubs.end()) {
+            deoptStubs[pc] = code.size();
+            emit({0xC7, 0x83}); // mov dword [rbx + resumePc], pc
+            emitContextOffset(CONTEXT_OFFSET(resumePc));
+            emit32((int)pc);
+            patch(emitJump(0xE9), errorStubs[DEOPTIMIZE]);
+        }
+        patch(deoptimizations[k].first, deoptStubs[pc]);
+    }
+
+    // Copy the code to executable memory, which is never writable at the same time
+    executableSize = code.size();
+    executable = mmap(NULL, executableSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(executable == MAP_FAILED) {
+        executable = NULL;
+        return false;
+    }
+    memcpy(executable, code.data(), executableSize);
+    if(mprotect(executable, executableSize, PROT_READ | PROT_EXEC) != 0) {
+        return false;
+    }
+    return true;
+}
+
+// Returns false if the generated code deoptimized, after which the
+// Interpreter has the state to continue the program with
+bool Jit::run() {
+    typedef void (*Entry)(JitContext *);
+
+    context.sp = valueStack + VALUE_STACK_GUARD - 1;
+    context.stackLimit = valueStack + VALUE_STACK_CELLS - 1;
+    context.tos = 0;
+    context.nativeStackTop = nativeStack + nativeStackSize;
+    context.rspLimit = nativeStack + NATIVE_STACK_RESERVE;
+    context.error = NO_ERROR;
+    refreshHeap();
+
+    ((Entry)executable)(&context);
+
+    switch(context.error) {
+        case RUNTIME_ERROR:
+            rethrow_exception(exception);
+        case STACK_OVERFLOW:
+            throw StackOverflowException();
+        case STACK_UNDERFLOW:
+            throw StackUnderflowException();
+        case CALL_OVERFLOW:
+            throw CallStackOverflowException();
+        case RETURN_WITHOUT_CALL:
+            throw ReturnWithoutCallException();
+        case DEOPTIMIZE:
+            deoptimize();
+            return false;
+        default:
+            break;
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <vector>
+#include <map>
+#include <utility>
+#include <initializer_list>
+#include <exception>
+#include <cstddef>
+
+#include "Interpreter.h"
+
+class Jit;
+
+// State shared between the generated code and the runtime helpers. The
+// generated code addresses these fields by their offset, so only plain
+// members belong here.
+struct JitContext {
+    long *sp; // Value stack pointer, points at the element below the top
+    long *stackLimit; // Last usable value stack slot
+    long tos; // Top of the stack, written back on exit
+    long *const *heapDirectory; // Heap page directory, reloaded when a page is added
+    long heapPages;
+    void *hostRsp; // Native stack pointer of the caller of run()
+    void *entryRsp; // Native stack pointer at the outermost call level
+    void *rspLimit; // Lowest native stack pointer allowed for CALL
+    void *nativeStackTop;
+    int error; // One of the Jit::Error codes, 0 when everything went fine
+    unsigned resumePc; // Where the interpreter continues after DEOPTIMIZE
+    void *deoptRsp; // Native stack pointer when the generated code exited
+    Jit *jit;
+};
+
+// Compiles a linked Program to x86-64 machine code. The top of the stack
+// is kept in a register, the rest of the value stack and the heap pages are
+// accessed inline, and CALL/ENDSUB become native call/ret on a private
+// native stack. Only I/O and new heap pages go through the Interpreter.
+// compile() returns false when the program (or the host) is not supported,
+// in which case the caller should run the Interpreter instead.
+//
+// Values are tagged Cells, and the generated code only handles small ones.
+// When a result would overflow into a BigInt, the code deoptimizes: it
+// exits before the instruction, hands its stacks to the Interpreter and
+// run() returns false so the Interpreter can finish the program.
+class Jit {
+    public:
+        enum Error {
+            NO_ERROR, RUNTIME_ERROR, STACK_OVERFLOW, STACK_UNDERFLOW, CALL_OVERFLOW, RETURN_WITHOUT_CALL, DEOPTIMIZE
+        };
+
+        Jit(Interpreter &);
+        ~Jit();
+        bool compile();
+        bool run();
+
+    private:
+        Interpreter &interpreter;
+        std::vector<unsigned char> code; // Machine code while it's being emitted
+        void *executable; // The same code in executable memory
+        size_t executableSize;
+        long *valueStack;
+        size_t valueStackSize;
+        char *nativeStack;
+        size_t nativeStackSize;
+        JitContext context;
+        std::exception_ptr exception; // Thrown by a runtime helper
+        std::vector<std::pair<size_t, unsigned> > deoptimizations; // Jumps to a deopt stub for a pc
+        std::map<size_t, unsigned> returnPcs; // Return address offset of every CALL to its pc
+
+        // Runtime helpers called from the generated code
+        static void helperStore(JitContext *, long, long);
+        static long helperRetrieve(JitContext *, long);
+        static void helperWriteChar(JitContext *, long);
+        static void helperWriteNumber(JitContext *, long);
+        static void helperReadChar(JitContext *, long);
+        static void helperReadNumber(JitContext *, long, long);
+        void refreshHeap();
+        void deoptimize();
+
+        // Emitting machine code
+        void emit(std::initializer_list<unsigned char>);
+        void emit32(int);
+        void emit64(long);
+        size_t emitJump(unsigned char, unsigned char = 0);
+        void patch(size_t, size_t);
+        void emitContextOffset(size_t);
+        void emitPushTos(size_t);
+        void emitPopTos();
+        void emitCall(void *);
+        void emitErrorCheck(size_t);
+        void emitReloadHeap();
+        std::pair<size_t, size_t> emitPageLookup();
+        void patchPageLookup(const std::pair<size_t, size_t> &, size_t);
+        void emitRetrieve(size_t);
+        void emitStore(size_t);
+        void emitDeoptimize(unsigned char, unsigned);
+        void emitImmediate(Opcode, long, unsigned);
+        void emitDepthCheck(unsigned, size_t);
+};
+
+#endif
@@ -0,0 +1,33 @@
+#include "Linker.h"
+
+using namespace std;
+
+Linker::Labels Linker::collectLabels(const Program &p) {
+    Labels labels;
+    unsigned size = p.size();
+
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(p[pc].op == MARK) {
+            // Go to the instruction after the label, so MARK is never executed by a jump
+            if(!labels.insert(make_pair(p[pc].arg, pc + 1)).second) {
+                throw DuplicateLabelException(p[pc].arg.toString());
+            }
+        }
+    }
+    return labels;
+}
+
+void Linker::link(Program &p) {
+    Labels labels = collectLabels(p);
+    unsigned size = p.size();
+
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(isBranch(p[pc].op)) {
+            auto target = labels.find(p[pc].arg);
+            if(target == labels.end()) {
+                throw LabelNotFoundException(p[pc].arg.toString());
+            }
+            p[pc].target = target->second;
+        }
+    }
+}
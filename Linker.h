@@ -0,0 +1,23 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include <map>
+#include <vector>
+
+#include "Types.h"
+#include "Exceptions.h"
+
+// Resolves labels once, before the program runs. Every MARK is collected
+// and the target of every CALL, JUMP, JUMPZERO and JUMPNEG is set to the
+// absolute index of the instruction following its MARK.
+class Linker {
+    public:
+        void link(Program &);
+
+    private:
+        typedef std::map<Cell, unsigned, LabelOrder> Labels; // Label to the index after its MARK
+
+        Labels collectLabels(const Program &);
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include <map>
+#include <utility>
+
+#include "Memoizer.h"
+
+using namespace std;
+
+// Finds the pure subroutines among the targets of all CALLs. Every target
+// starts out pure with an unknown arity, and is analyzed again until
+// nothing changes any more. A subroutine that calls one with an unknown
+// arity skips that path, so recursion gets its arity from the paths that
+// return without recursing. An arity that changes afterwards makes the
+// subroutine impure, so every subroutine changes at most twice.
+Memoizer::Memoizer(const Program &p) {
+    subroutines.assign(p.size() + 1, Subroutine{false, false, 0, 0});
+    pures = 0;
+    hits = misses = 0;
+
+    for(const Instruction &in : p) {
+        if(in.op == CALL) {
+            subroutines[in.target].pure = true;
+        }
+    }
+
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(unsigned target = 0; target < subroutines.size(); target++) {
+            Subroutine &subroutine = subroutines[target];
+            if(!subroutine.pure) {
+                continue;
+            }
+            Subroutine result = subroutine;
+            if(!analyze(p, target, result)) {
+                subroutine.pure = false;
+                changed = true;
+            } else if(result.returns && !subroutine.returns) {
+                subroutine = result;
+                changed = true;
+            } else if(result.returns && (result.inputs != subroutine.inputs || result.outputs != subroutine.outputs)) {
+                subroutine.pure = false;
+                changed = true;
+            }
+        }
+    }
+
+    // Subroutines that never return or take too many values stay pure for
+    // their callers, but aren't memoized themselves
+    for(Subroutine &subroutine : subroutines) {
+        if(subroutine.pure && (!subroutine.returns || subroutine.inputs > MAX_VALUES || subroutine.outputs > MAX_VALUES)) {
+            subroutine.pure = false;
+        }
+        pures += (subroutine.pure ? 1 : 0);
+    }
+    if(pures > 0) {
+        table.resize(TABLE_SIZE, Entry{0, {}, {}});
+    }
+}
+
+unsigned Memoizer::pureCount() const {
+    return pures;
+}
+
+unsigned long long Memoizer::hitCount() const {
+    return hits;
+}
+
+unsigned long long Memoizer::missCount() const {
+    return misses;
+}
+
+// Follows every path from the target with the depth of the stack relative
+// to the call. Returns false if the subroutine is impure, or if two paths
+// reach an instruction with different depths.
+bool Memoizer::analyze(const Program &p, unsigned target, Subroutine &result) const {
+    map<unsigned, long> depths;
+    vector<pair<unsigned, long>> work(1, make_pair(target, 0L));
+    long lowest = 0, end = 0;
+    bool returns = false;
+
+    while(!work.empty()) {
+        unsigned pc = work.back().first;
+        long depth = work.back().second;
+        work.pop_back();
+        if(pc >= p.size()) {
+            return false; // Ends the program
+        }
+        auto seen = depths.insert(make_pair(pc, depth));
+        if(!seen.second) {
+            if(seen.first->second != depth) {
+                return false;
+            }
+            continue;
+        }
+
+        const Instruction &in = p[pc];
+        long need = 0, effect = 0; // Values read below the depth, and the change in depth
+        switch(in.op) {
+            case PUSH: effect = 1; break;
+            case DUP: need = 1; effect = 1; break;
+            case COPY: case SLIDE: {
+                if(!in.arg.isSmall() || in.arg.small() < 0) {
+                    return false;
+                }
+                need = in.arg.small() + 1;
+                effect = (in.op == COPY ? 1 : -in.arg.small());
+                break;
+            }
+            case SWAP: need = 2; break;
+            case DISCARD: need = 1; effect = -1; break;
+            case ADD: case SUB: case MUL: case DIV: case MOD: need = 2; effect = -1; break;
+            case PUSHADD: case PUSHSUB: case PUSHMUL: need = 1; break;
+            case MARK: case JUMP: break;
+            case JUMPZERO: case JUMPNEG: need = 1; effect = -1; break;
+            case DUPJUMPZERO: case DUPJUMPNEG: need = 1; break;
+            case CALL: {
+                const Subroutine &callee = subroutines[in.target];
+                if(!callee.pure) {
+                    return false;
+                }
+                if(!callee.returns) {
+                    continue; // Not known yet, maybe in a later round
+                }
+                need = callee.inputs;
+                effect = (long)callee.outputs - (long)callee.inputs;
+                break;
+            }
+            case ENDSUB: {
+                if(returns && end != depth) {
+                    return false;
+                }
+                returns = true;
+                end = depth;
+                continue;
+            }
+            default:
+                return false; // Heap access, I/O and ENDPROG
+        }
+
+        lowest = min(lowest, depth - need);
+        depth += effect;
+        if(isBranch(in.op) && in.op != CALL) {
+            work.push_back(make_pair(in.target, depth));
+        }
+        if(in.op != JUMP) {
+            work.push_back(make_pair(pc + 1, depth));
+        }
+    }
+
+    result.returns = returns;
+    result.inputs = -lowest;
+    result.outputs = end - lowest;
+    return true;
+}
+
+Memoizer::Entry &Memoizer::slot(unsigned target, const long *arguments) {
+    unsigned long hash = target * 0x9e3779b97f4a7c15UL;
+    for(unsigned k = 0; k < subroutines[target].inputs; k++) {
+        hash = (hash ^ (unsigned long)arguments[k]) * 0x100000001b3UL;
+    }
+    return table[(hash >> 32) & (TABLE_SIZE - 1)];
+}
+
+bool Memoizer::call(unsigned target, ValueStack &stack, size_t depth) {
+    const Subroutine &subroutine = subroutines[target];
+    if(!subroutine.pure || stack.size() < subroutine.inputs) {
+        return false; // Too few arguments fails in the subroutine itself
+    }
+
+    Call call;
+    call.depth = depth;
+    call.base = stack.size() - subroutine.inputs;
+    call.target = target;
+    for(unsigned k = 0; k < subroutine.inputs; k++) {
+        const Cell &argument = stack[call.base + k];
+        if(!argument.isSmall()) {
+            return false;
+        }
+        call.arguments[k] = argument.toBits();
+    }
+
+    Entry &entry = slot(target, call.arguments);
+    bool hit = (entry.target == target);
+    for(unsigned k = 0; hit && k < subroutine.inputs; k++) {
+        hit = (entry.arguments[k] == call.arguments[k]);
+    }
+    if(!hit) {
+        misses++;
+        pending.push_back(call);
+        return false;
+    }
+
+    hits++;
+    for(unsigned k = 0; k < subroutine.inputs; k++) {
+        stack.pop();
+    }
+    for(unsigned k = 0; k < subroutine.outputs; k++) {
+        stack.push(entry.results[k]);
+    }
+    return true;
+}
+
+void Memoizer::store(const ValueStack &stack) {
+    Call call = pending.back();
+    pending.pop_back();
+    const Subroutine &subroutine = subroutines[call.target];
+
+    Entry &entry = slot(call.target, call.arguments);
+    entry.target = call.target;
+    for(unsigned k = 0; k < subroutine.inputs; k++) {
+        entry.arguments[k] = call.arguments[k];
+    }
+    for(unsigned k = 0; k < subroutine.outputs; k++) {
+        entry.results[k] = stack[call.base + k];
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef MEMOIZER_H
+#define MEMOIZER_H
+
+#include <vector>
+
+#include "Types.h"
+#include "ValueStack.h"
+
+// Remembers the results of pure subroutines when run with --memoize. A
+// subroutine is pure if nothing it can reach does I/O, touches the heap or
+// ends the program, and it only calls pure subroutines. Its arity is found
+// by following the depth of the stack through it: it reads at most inputs
+// values that were on the stack when it was called, and replaces them with
+// outputs values on ENDSUB.
+//
+// Results are kept in a direct-mapped table keyed by the subroutine and its
+// arguments, where a new result replaces the one in its slot. Only small
+// arguments are used as keys. The switch engine asks the Memoizer on every
+// CALL, and skips the call altogether on a hit.
+class Memoizer {
+    public:
+        static const unsigned MAX_VALUES = 4; // Arguments and results of a memoized subroutine
+        static const unsigned TABLE_SIZE = 1 << 16;
+
+        Memoizer(const Program &); // The linked program
+
+        // On CALL, before the return address is pushed. Returns true on a
+        // hit, after replacing the arguments with the results.
+        bool call(unsigned target, ValueStack &, size_t depth);
+
+        // On ENDSUB, before the return address is popped
+        void leave(const ValueStack &stack, size_t depth) {
+            if(!pending.empty() && pending.back().depth + 1 == depth) {
+                store(stack);
+            }
+        }
+
+        unsigned pureCount() const;
+        unsigned long long hitCount() const;
+        unsigned long long missCount() const;
+
+    private:
+        struct Subroutine {
+            bool pure; // So far, until the analysis is done
+            bool returns; // Whether a way back to the caller has been found
+            unsigned inputs, outputs;
+        };
+
+        struct Entry {
+            unsigned target; // 0 for an empty slot, no subroutine starts the program
+            long arguments[MAX_VALUES];
+            Cell results[MAX_VALUES];
+        };
+
+        struct Call {
+            size_t depth; // Of the call stack
+            size_t base; // Where the arguments start on the value stack
+            unsigned target;
+            long arguments[MAX_VALUES];
+        };
+
+        std::vector<Subroutine> subroutines; // Indexed by the target, memoized if pure and returns
+        std::vector<Entry> table;
+        std::vector<Call> pending; // Calls that missed, innermost last
+        unsigned pures;
+        unsigned long long hits, misses;
+
+        bool analyze(const Program &, unsigned, Subroutine &) const;
+        Entry &slot(unsigned, const long *);
+        void store(const ValueStack &);
+};
+
+#endif
@@ -0,0 +1,351 @@
+#include <climits>
+#include <set>
+
+#include "Optimizer.h"
+
+using namespace std;
+
+Optimizer::Optimizer() {
+    fused = 0;
+    folded = 0;
+    threaded = 0;
+    idioms = 0;
+    removed = 0;
+}
+
+unsigned Optimizer::fusedCount() const {
+    return fused;
+}
+
+unsigned Optimizer::foldedCount() const {
+    return folded;
+}
+
+unsigned Optimizer::threadedCount() const {
+    return threaded;
+}
+
+unsigned Optimizer::idiomCount() const {
+    return idioms;
+}
+
+unsigned Optimizer::removedCount() const {
+    return removed;
+}
+
+Program Optimizer::optimize(const Program &p) {
+    Program out = rewrite(p);
+    Labels labels;
+
+    if(collectLabels(out, labels)) {
+        threadJumps(out, labels);
+        removeDeadCode(out, labels);
+        out = rewrite(out);
+        recognizeLoops(out);
+    }
+    return out;
+}
+
+// Instructions are appended to the output one at a time and the patterns
+// are matched against its tail, so a removal that exposes a new pattern
+// (e.g. PUSH 1; SWAP; SWAP; ADD) is picked up without another pass.
+Program Optimizer::rewrite(const Program &p) {
+    Program out;
+    out.reserve(p.size());
+
+    for(unsigned k = 0; k < p.size(); k++) {
+        out.push_back(p[k]);
+        while(peephole(out));
+    }
+    return out;
+}
+
+// Replaces the last n instructions with op, keeping the argument of the
+// first one (the PUSH) or of the last one (the branch).
+void Optimizer::fuse(Program &out, unsigned n, Opcode op) {
+    unsigned first = out.size() - n;
+    Cell arg = (isBranch(op) ? out.back().arg : out[first].arg);
+
+    out.erase(out.begin() + first, out.end());
+    out.push_back(Instruction(op, arg));
+    removed += n - 1;
+    fused++;
+}
+
+bool Optimizer::peephole(Program &out) {
+    unsigned size = out.size();
+    if(size < 2) {
+        return false;
+    }
+    Opcode last = out[size - 1].op, previous = out[size - 2].op;
+
+    if(fold(out)) {
+        return true;
+    }
+
+    // Sequences without any effect
+    if((previous == SWAP && last == SWAP) ||
+       (previous == DUP && last == DISCARD) ||
+       (previous == PUSH && last == DISCARD)) {
+        out.erase(out.end() - 2, out.end());
+        removed += 2;
+        return true;
+    }
+
+    if(previous == PUSH) {
+        switch(last) {
+            case ADD: fuse(out, 2, PUSHADD); return true;
+            case SUB: fuse(out, 2, PUSHSUB); return true;
+            case MUL: fuse(out, 2, PUSHMUL); return true;
+            case RETRIEVE: fuse(out, 2, PUSHRETRIEVE); return true;
+            case WRITEC: fuse(out, 2, PUSHWRITEC); return true;
+            default: break;
+        }
+    }
+    if(previous == DUP) {
+        switch(last) {
+            case JUMPZERO: fuse(out, 2, DUPJUMPZERO); return true;
+            case JUMPNEG: fuse(out, 2, DUPJUMPNEG); return true;
+            default: break;
+        }
+    }
+    if(size >= 3 && out[size - 3].op == PUSH && previous == SWAP && last == STORE) {
+        fuse(out, 3, PUSHSTORE);
+        return true;
+    }
+    return false;
+}
+
+// The result of an arithmetic instruction, applied to a and b
+static Cell calculate(Opcode op, const Cell &a, const Cell &b) {
+    switch(op) {
+        case ADD: case PUSHADD: return a + b;
+        case SUB: case PUSHSUB: return a - b;
+        case MUL: case PUSHMUL: return a * b;
+        case DIV: return a / b;
+        default: return a % b;
+    }
+}
+
+// Arithmetic and branches on the values of PUSHes. Division by zero is left
+// in place to fail when the program runs.
+bool Optimizer::fold(Program &out) {
+    unsigned size = out.size();
+    Opcode last = out[size - 1].op;
+    if(out[size - 2].op != PUSH) {
+        return false;
+    }
+    Cell value = out[size - 2].arg;
+
+    switch(last) {
+        case ADD: case SUB: case MUL: case DIV: case MOD:
+            if(size < 3 || out[size - 3].op != PUSH || ((last == DIV || last == MOD) && value.isZero())) {
+                return false;
+            }
+            out[size - 3].arg = calculate(last, out[size - 3].arg, value);
+            out.erase(out.end() - 2, out.end());
+            removed += 2;
+            break;
+        case PUSHADD: case PUSHSUB: case PUSHMUL:
+            out[size - 2].arg = calculate(last, value, out[size - 1].arg);
+            out.pop_back();
+            removed++;
+            break;
+        case JUMPZERO: case JUMPNEG: {
+            // Becomes a JUMP if taken, and disappears otherwise
+            bool taken = (last == JUMPZERO ? value.isZero() : value.isNegative());
+            Cell label = out[size - 1].arg;
+            out.erase(out.end() - 2, out.end());
+            removed += 2;
+            if(taken) {
+                out.push_back(Instruction(JUMP, label));
+                removed--;
+            }
+            break;
+        }
+        case DUPJUMPZERO: case DUPJUMPNEG: {
+            // The same, but the value stays on the stack
+            bool taken = (last == DUPJUMPZERO ? value.isZero() : value.isNegative());
+            if(taken) {
+                out[size - 1].op = JUMP;
+            } else {
+                out.pop_back();
+                removed++;
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+    folded++;
+    return true;
+}
+
+// Collects the labels, or returns false if the Linker would fail on them
+bool Optimizer::collectLabels(const Program &p, Labels &labels) {
+    for(unsigned pc = 0; pc < p.size(); pc++) {
+        if(p[pc].op == MARK && !labels.insert(make_pair(p[pc].arg, pc)).second) {
+            return false;
+        }
+    }
+    for(unsigned pc = 0; pc < p.size(); pc++) {
+        if(isBranch(p[pc].op) && labels.count(p[pc].arg) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The first instruction from pc on that isn't a MARK
+unsigned Optimizer::follow(const Program &p, unsigned pc) {
+    while(pc < p.size() && p[pc].op == MARK) {
+        pc++;
+    }
+    return pc;
+}
+
+// A branch to a label that only leads to a JUMP might as well branch to
+// where that JUMP goes, and a JUMP to ENDSUB or ENDPROG might as well be
+// that instruction. The number of steps is limited for JUMPs in a cycle.
+void Optimizer::threadJumps(Program &p, const Labels &labels) {
+    for(unsigned pc = 0; pc < p.size(); pc++) {
+        if(!isBranch(p[pc].op)) {
+            continue;
+        }
+        Cell label = p[pc].arg;
+        unsigned next = follow(p, labels.at(label) + 1);
+        for(unsigned steps = 0; steps < labels.size(); steps++) {
+            if(next == p.size() || p[next].op != JUMP || sameLabel(p[next].arg, label)) {
+                break;
+            }
+            label = p[next].arg;
+            next = follow(p, labels.at(label) + 1);
+        }
+
+        if(p[pc].op == JUMP && next < p.size() && (p[next].op == ENDSUB || p[next].op == ENDPROG)) {
+            p[pc] = Instruction(p[next].op);
+            threaded++;
+        } else if(!sameLabel(label, p[pc].arg)) {
+            p[pc].arg = label;
+            threaded++;
+        }
+    }
+}
+
+// Removes the instructions that can't be reached, JUMPs to the instruction
+// right after them and MARKs no remaining branch refers to
+void Optimizer::removeDeadCode(Program &p, const Labels &labels) {
+    vector<bool> keep = reachable(p, labels);
+    unsigned size = p.size();
+
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(keep[pc] && p[pc].op == JUMP) {
+            unsigned target = labels.at(p[pc].arg), between = pc + 1;
+            while(between < target && (!keep[between] || p[between].op == MARK)) {
+                between++;
+            }
+            keep[pc] = (target < pc || between < target);
+        }
+    }
+
+    set<Cell, LabelOrder> used;
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(keep[pc] && isBranch(p[pc].op)) {
+            used.insert(p[pc].arg);
+        }
+    }
+
+    Program out;
+    out.reserve(size);
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(keep[pc] && (p[pc].op != MARK || used.count(p[pc].arg) > 0)) {
+            out.push_back(p[pc]);
+        } else {
+            removed++;
+        }
+    }
+    p.swap(out);
+}
+
+// Follows every path from the start. A CALL is assumed to return, so the
+// instruction after it is reachable too.
+vector<bool> Optimizer::reachable(const Program &p, const Labels &labels) {
+    vector<bool> seen(p.size(), false);
+    vector<unsigned> work(1, 0);
+
+    while(!work.empty()) {
+        unsigned pc = work.back();
+        work.pop_back();
+        if(pc >= p.size() || seen[pc]) {
+            continue;
+        }
+        seen[pc] = true;
+
+        Opcode op = p[pc].op;
+        if(isBranch(op)) {
+            work.push_back(labels.at(p[pc].arg));
+        }
+        if(op != JUMP && op != ENDSUB && op != ENDPROG) {
+            work.push_back(pc + 1);
+        }
+    }
+    return seen;
+}
+
+// The loops that have an idiom, after their MARK. The exit is the step
+// with the label the loop ends at.
+static const long ANY = LONG_MIN; // Any argument
+static const unsigned MAX_STEPS = 9;
+
+struct LoopStep {
+    Opcode op;
+    long arg;
+};
+
+struct LoopShape {
+    Opcode idiom;
+    unsigned length, exit;
+    LoopStep steps[MAX_STEPS]; // Ending in a JUMP to the MARK
+};
+
+static const LoopShape LOOP_SHAPES[] = {
+    {WRITESTRING, 6, 2, {{DUP, ANY}, {RETRIEVE, ANY}, {DUPJUMPZERO, ANY}, {WRITEC, ANY}, {PUSHADD, 1}, {JUMP, ANY}}},
+    {FILLHEAP, 9, 0, {{DUPJUMPZERO, ANY}, {SWAP, ANY}, {DUP, ANY}, {PUSH, ANY}, {STORE, ANY},
+                      {PUSHADD, 1}, {SWAP, ANY}, {PUSHSUB, 1}, {JUMP, ANY}}},
+    {COPYHEAP, 9, 0, {{DUPJUMPZERO, ANY}, {PUSHSUB, 1}, {DUP, ANY}, {PUSHADD, ANY}, {COPY, 1},
+                      {PUSHADD, ANY}, {RETRIEVE, ANY}, {STORE, ANY}, {JUMP, ANY}}}
+};
+
+static bool matches(const Program &p, unsigned mark, const LoopShape &shape) {
+    if(mark + shape.length >= p.size()) {
+        return false;
+    }
+    for(unsigned k = 0; k < shape.length; k++) {
+        const Instruction &in = p[mark + 1 + k];
+        const LoopStep &step = shape.steps[k];
+        if(in.op != step.op || (step.arg != ANY && !(in.arg.isSmall() && in.arg.small() == step.arg))) {
+            return false;
+        }
+    }
+    return sameLabel(p[mark + shape.length].arg, p[mark].arg);
+}
+
+void Optimizer::recognizeLoops(Program &p) {
+    Program out;
+    out.reserve(p.size());
+
+    for(unsigned pc = 0; pc < p.size(); pc++) {
+        out.push_back(p[pc]);
+        if(p[pc].op != MARK) {
+            continue;
+        }
+        for(const LoopShape &shape : LOOP_SHAPES) {
+            if(matches(p, pc, shape)) {
+                out.push_back(Instruction(shape.idiom, p[pc + 1 + shape.exit].arg));
+                idioms++;
+                break;
+            }
+        }
+    }
+    p.swap(out);
+}
@@ -0,0 +1,66 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <map>
+#include <vector>
+
+#include "Types.h"
+
+// Optimizer that runs between the Parser and the Linker.
+//
+// The peephole pass folds arithmetic and branches on constants, fuses
+// common instruction sequences into superinstructions with an immediate
+// argument and removes sequences without any effect. MARK is never part of
+// a pattern, so no jump target ends up inside a fused sequence.
+//
+// The block pass then threads branches through chains of JUMPs to their
+// final target, removes code that can't be reached, JUMPs to the next
+// instruction and MARKs no branch refers to. That joins blocks, so the
+// peephole pass runs once more afterwards. Programs the Linker would
+// reject skip the block pass, so they fail in the same way.
+//
+// Last, loops of a few common shapes get a loop idiom in front of them,
+// which does the work of the whole loop at once:
+//
+//   WRITESTRING  MARK L; DUP; RETRIEVE; DUPJUMPZERO E; WRITEC; PUSHADD 1; JUMP L
+//   FILLHEAP     MARK L; DUPJUMPZERO E; SWAP; DUP; PUSH v; STORE; PUSHADD 1;
+//                SWAP; PUSHSUB 1; JUMP L
+//   COPYHEAP     MARK L; DUPJUMPZERO E; PUSHSUB 1; DUP; PUSHADD to; COPY 1;
+//                PUSHADD from; RETRIEVE; STORE; JUMP L
+//
+// These are the forms the peephole pass leaves of the plain loops, like
+// DUP; JUMPZERO E for DUPJUMPZERO E. The idiom reads v, to and from from
+// the loop, which stays in place behind it.
+class Optimizer {
+    public:
+        Optimizer();
+        Program optimize(const Program &);
+        unsigned fusedCount() const;
+        unsigned foldedCount() const;
+        unsigned threadedCount() const;
+        unsigned idiomCount() const;
+        unsigned removedCount() const;
+
+    private:
+        typedef std::map<Cell, unsigned, LabelOrder> Labels; // Label to the index of its MARK
+
+        unsigned fused; // Superinstructions created
+        unsigned folded; // Operations on constants done in advance
+        unsigned threaded; // Branches sent straight to the end of a JUMP chain
+        unsigned idioms; // Loops that got a loop idiom
+        unsigned removed; // Instructions removed from the program
+
+        Program rewrite(const Program &);
+        bool peephole(Program &);
+        bool fold(Program &);
+        void fuse(Program &, unsigned, Opcode);
+
+        bool collectLabels(const Program &, Labels &);
+        unsigned follow(const Program &, unsigned);
+        void threadJumps(Program &, const Labels &);
+        void removeDeadCode(Program &, const Labels &);
+        std::vector<bool> reachable(const Program &, const Labels &);
+        void recognizeLoops(Program &);
+};
+
+#endif
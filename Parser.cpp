@@ -3,259 +3,122 @@
 
 using namespace std;
 
-// Note: could be implemented using some sort of lookup table
-// data structure indexed by a pair of enums.
-Mode Parser::determineMode(const Token t1, const Token t2) {
-    switch(t1) {
-        case LINEFEED:
-            return FLOWCONT;
-        case SPACE:
-            return STACKMANIP;
-        case TAB:
-            switch(t2) {
-                case LINEFEED:
-                    return IO;
-                case SPACE:
-                    return ARITH;
-                case TAB:
-                    return HEAPACC;
-                default:
-                    throw UnreachableTokenException();
-            }
-        default:
-            throw UnreachableTokenException();
-    }
-}
-
-vector<Token> Parser::tokenize(const string &program) {
+// Only used to print the tokens; parse() reads the source directly
+vector<Token> Parser::tokenize(const char *data, size_t size) {
+    vector<unsigned char> compacted(size);
+    size_t count = classifier.compact(data, size, compacted.data());
     vector<Token> tokens;
-
-    for(auto k = program.begin(); k != program.end(); k++) {
-        switch(*k) {
-            case '\n':
-                tokens.push_back(LINEFEED);
-                break;
-            case ' ':
-                tokens.push_back(SPACE);
-                break;
-            case '\t':
-                tokens.push_back(TAB);
-                break;
-        }
+    for(size_t k = 0; k < count; k++) {
+        tokens.push_back((Token)compacted[k]);
     }
     return tokens;
 }
 
-Program Parser::tokensToProgram(const vector<Token> &tokens) {
-    int amount = tokens.size();
-    if(amount < 3) {
-        exit(0); // Empty program
-    }
-
-    Mode m;
-    try {
-        m = determineMode(tokens[0], tokens[1]);
-    } catch (exception& e) { // Unreachable token exception
-        throw e;
-    }
+// Decodes the source in a single pass. The source is classified a block
+// at a time, so comment bytes are dropped without building a token vector
+// for the whole source, and instructions are decoded with the table in
+// DecodeTable.h.
+Program Parser::parse(const char *data, size_t size) {
     Program p;
-
-    // FLOWCONT and STACKMANIP are only 1 token long, the rest is 2 tokens long
-    int start = ((m == FLOWCONT || m == STACKMANIP) ? 1 : 2);
-
-    for(int k = start; k < amount; k++) {
-        if(k == amount) {
-            cout << "k has reached max" << endl; // We might want to use an exception here...
-        }
-
-        if(m == STACKMANIP) {
-            processStackManip(tokens, p, k);
-        } else if(m == ARITH) {
-            processArith(tokens, p, k);
-        } else if(m == HEAPACC) {
-            processHeapAcc(tokens, p, k);
-        } else if(m == FLOWCONT) {
-            processFlowCont(tokens, p, k);
-        } else if(m == IO) {
-            processIO(tokens, p, k);
-        } else {
-            throw UnreachableTokenException();
-        }
-        k++; // Proceed to next instruction
-        if(k != amount) {
-            m = determineMode(tokens[k], tokens[k + 1]);
-            if(!(m == STACKMANIP || m == FLOWCONT)) {
-                k++;
-            }
+    cursor = data;
+    end = data + size;
+    blockStart = blockEnd = 0;
+
+    while(skipComments()) {
+        // Walk the instruction trie until it ends in an instruction or an error
+        unsigned state = 0;
+        DecodeEntry entry;
+        do {
+            state = state * 4 + nextToken() + 1;
+            entry = Decoder::entries[state];
+        } while(entry.kind == CONTINUE);
+
+        switch(entry.kind) {
+            case NO_ARGUMENT:
+                p.push_back(entry.op);
+                break;
+            case NUMBER_ARGUMENT:
+                p.push_back(Instruction(entry.op, parseNumber()));
+                break;
+            case LABEL_ARGUMENT:
+                p.push_back(Instruction(entry.op, parseLabel()));
+                break;
+            default:
+                throw UnreachableTokenException();
         }
     }
     return p;
 }
 
-// Side-effect: mutates the index from the for-loop in tokensToProgram
-// Labels are also represented as numbers, so labels will be handled as well.
-long Parser::tokensToNumber(const vector<Token> &tokens, int &index) {
-    vector<Token> binNum;
-    int amount = tokens.size();
-    int sign;
-    long sum = 0;
-
-    while(tokens[index] != LINEFEED) { // A number is terminated by a LINEFEED
-        binNum.push_back(tokens[index++]);
-        if(index == amount) {
-            throw PrematureEndException();
+// Classifies blocks of the source until one of them contains tokens
+bool Parser::refill() {
+    while(cursor != end) {
+        size_t size = min((size_t)(end - cursor), BLOCK_SIZE);
+        blockStart = 0;
+        blockEnd = classifier.compact(cursor, size, block);
+        cursor += size;
+        if(blockEnd > 0) {
+            return true;
         }
     }
-
-    if(binNum.front() == SPACE) {
-        sign = 1;
-    } else if(binNum.front() == TAB) {
-        sign = -1;
-    } else {
-        throw UndefinedSignException();
-    }
-    binNum.erase(binNum.begin()); // Pop the sign bit
-    for(int k = binNum.size() - 1; k >= 0; k--) {
-    	//cout << "Sum = " << sum << endl;
-        sum += ((binNum[k] == TAB) ? pow(2, k) : 0);
-    }
-    return sign * sum;
+    return false;
 }
 
-void Parser::parseNumber(const vector<Token> &tokens, Program &p, int &k) {
-    if(tokens[++k] == LINEFEED) { // No label as argument
-        throw NoLabelArgumentException();
-    } else { // We're going to parse the label now
-        p.push_back(tokensToNumber(tokens, k));
+// Numbers are a sign followed by bits, most significant first, and are
+// terminated by a LINEFEED.
+Cell Parser::parseNumber() {
+    Token sign = nextToken();
+    if(sign == LINEFEED) { // No number as argument
+        throw NoNumericArgumentException();
     }
-}
 
-void Parser::processStackManip(const vector<Token> &tokens, Program &p, int &k) {
-    if(tokens[k] == SPACE) { // PUSH
-        p.push_back(PUSH);
-        parseNumber(tokens, p, k);
-    } else if(tokens[k] == TAB) {
-        k++;
-        if(tokens[k] == SPACE) { // COPY
-            p.push_back(COPY);
-        } else if(tokens[k] == LINEFEED) { // SLIDE
-            p.push_back(SLIDE);
-        } else {
-            throw UnreachableTokenException();
+    long sum = 0;
+    unsigned length = 0;
+    vector<bool> bits; // Only used when the number doesn't fit in a machine word
+    for(Token t = nextToken(); t != LINEFEED; t = nextToken(), length++) {
+        if(length < 62) {
+            sum = (sum << 1) | (t == TAB ? 1 : 0);
+            continue;
         }
-        // COPY and SLIDE both require a numeric argument,
-        // so we shall try to parse a number now
-        parseNumber(tokens, p, k);
-    } else if(tokens[k] == LINEFEED) { // DUP, SWAP or DISCARD
-        // Could perhaps also be done more concisely
-        // with the ?:-operator, but I reckon something will go wrong
-        // in the exception branch
-        k++;
-        if(tokens[k] == SPACE) { // DUP
-            p.push_back(DUP);
-        } else if(tokens[k] == TAB) { // SWAP
-            p.push_back(SWAP);
-        } else if(tokens[k] == LINEFEED) { // DISCARD
-            p.push_back(DISCARD);
-        } else {
-            throw UnreachableTokenException();
+        if(length == 62) {
+            for(int k = 61; k >= 0; k--) {
+                bits.push_back((sum >> k) & 1);
+            }
         }
-    } else {
-        throw UnreachableTokenException();
+        bits.push_back(t == TAB);
     }
-}
 
-void Parser::processArith(const vector<Token> &tokens, Program &p, int &k) {
-    if(tokens[k] == SPACE) {
-        k++;
-        if(tokens[k] == SPACE) { // ADD
-            p.push_back(ADD);
-        } else if(tokens[k] == TAB) { // SUB
-            p.push_back(SUB);
-        } else if(tokens[k] == LINEFEED) { // MUL
-            p.push_back(MUL);
-        } else {
-            throw UnreachableTokenException();
-        }
-    } else if(tokens[k] == TAB) {
-        k++;
-        if(tokens[k] == SPACE) { // DIV
-            p.push_back(DIV);
-        } else if(tokens[k] == TAB) { // MOD
-            p.push_back(MOD);
-        } else {
-            throw UnreachableTokenException();
-        }
-    } else {
-        throw UnreachableTokenException();
+    if(length > 62) {
+        return Cell(BigInt::fromBits(bits, sign == TAB));
     }
+    return Cell(sign == TAB ? -sum : sum);
 }
 
-void Parser::processHeapAcc(const vector<Token> &tokens, Program &p, int &k) {
-    if(tokens[k] == SPACE) { // STORE
-        p.push_back(STORE);
-    } else if(tokens[k] == TAB) { // RETRIEVE
-        p.push_back(RETRIEVE);
-    } else {
-        throw UnreachableTokenException();
+// Labels are unsigned bit strings, so unlike numbers there is no sign to
+// strip. A leading 1 is kept as a sentinel to tell e.g. "S" and "SS" apart.
+// Like numbers, labels that don't fit in a machine word become a BigInt.
+Cell Parser::parseLabel() {
+    if(!skipComments()) {
+        throw NoLabelArgumentException();
     }
-}
-
-void Parser::processFlowCont(const vector<Token> &tokens, Program &p, int &k) {
-    if(tokens[k] == SPACE) {
-        k++;
-        if(tokens[k] == SPACE) { // MARK
-            p.push_back(MARK);
-            parseNumber(tokens, p, k);
-        } else if(tokens[k] == TAB) { // CALL
-            p.push_back(CALL);
-            parseNumber(tokens, p, k);
-        } else if(tokens[k] == LINEFEED) { // JUMP
-            p.push_back(JUMP);
-            parseNumber(tokens, p, k);
-        } else {
-            throw UnreachableTokenException();
+    long label = 1;
+    unsigned length = 0;
+    vector<bool> bits; // Only used when the label doesn't fit in a machine word
+    for(Token t = nextToken(); t != LINEFEED; t = nextToken(), length++) {
+        if(length < 61) {
+            label = (label << 1) | (t == TAB ? 1 : 0);
+            continue;
         }
-    } else if(tokens[k] == TAB) {
-        k++;
-        if(tokens[k] == SPACE) { // JUMPZERO
-            p.push_back(JUMPZERO);
-            parseNumber(tokens, p, k);
-        } else if(tokens[k] == TAB) { // JUMPNEG
-            p.push_back(JUMPNEG);
-            parseNumber(tokens, p, k);
-        } else if(tokens[k] == LINEFEED) { // ENDSUB
-            p.push_back(ENDSUB);
-        } else {
-            throw UnreachableTokenException();
+        if(length == 61) {
+            for(int k = 61; k >= 0; k--) {
+                bits.push_back((label >> k) & 1);
+            }
         }
-    } else if(tokens[k] == LINEFEED && tokens[++k] == LINEFEED) { // ENDPROG
-        p.push_back(ENDPROG);
-    } else {
-        throw UnreachableTokenException();
+        bits.push_back(t == TAB);
     }
-}
 
-void Parser::processIO(const vector<Token> &tokens, Program &p, int &k) {
-    if(tokens[k] == SPACE) {
-        k++;
-        if(tokens[k] == SPACE) { // WRITEC
-            p.push_back(WRITEC);
-        } else if(tokens[k] == TAB) { // WRITEN
-            p.push_back(WRITEN);
-        } else {
-            throw UnreachableTokenException();
-        }
-    } else if(tokens[k] == TAB) {
-        k++;
-        if(tokens[k] == SPACE) { // READC
-            p.push_back(READC);
-        } else if(tokens[k] == TAB) { // READN
-            p.push_back(READN);
-        } else {
-            throw UnreachableTokenException();
-        }
-    } else {
-        throw UnreachableTokenException();
+    if(length > 61) {
+        return Cell(BigInt::fromBits(bits, false));
     }
+    return Cell(label);
 }
@@ -3,26 +3,44 @@
 
 #include <vector>
 #include <string>
+#include <cstddef>
 #include <iostream>
-#include <cmath>
 
 #include "Interpreter.h"
+#include "Classifier.h"
+#include "DecodeTable.h"
 #include "Exceptions.h"
 
 class Parser {
     public:
-        std::vector<Token> tokenize(const std::string &);
-        Program tokensToProgram(const std::vector<Token> &);
+        std::vector<Token> tokenize(const char *, size_t);
+        Program parse(const char *, size_t);
 
     private:
-        Mode determineMode(const Token, const Token);
-        long tokensToNumber(const std::vector<Token> &, int &);
-        void parseNumber(const std::vector<Token> &, Program &, int &);
-        void processStackManip(const std::vector<Token> &, Program &, int &);
-        void processArith(const std::vector<Token> &, Program &, int &);
-        void processHeapAcc(const std::vector<Token> &, Program &, int &);
-        void processFlowCont(const std::vector<Token> &, Program &, int &);
-        void processIO(const std::vector<Token> &, Program &, int &);
+        static const size_t BLOCK_SIZE = 64 * 1024; // Source bytes classified at once
+
+        Classifier classifier;
+        const char *cursor; // Next byte of the source that hasn't been classified
+        const char *end;
+        unsigned char block[BLOCK_SIZE]; // Tokens of the current block of the source
+        size_t blockStart, blockEnd; // The tokens parse() hasn't read yet
+
+        // Returns false at the end of the source
+        bool skipComments() {
+            return blockStart != blockEnd || refill();
+        }
+
+        // The source may not end halfway an instruction
+        Token nextToken() {
+            if(blockStart == blockEnd && !refill()) {
+                throw PrematureEndException();
+            }
+            return (Token)block[blockStart++];
+        }
+
+        bool refill();
+        Cell parseNumber();
+        Cell parseLabel();
 };
 
 #endif
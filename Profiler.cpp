@@ -0,0 +1,138 @@
+#include <map>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "Profiler.h"
+
+using namespace std;
+
+static const unsigned HOTTEST = 20; // Instructions listed in the report
+
+Profiler::Profiler(unsigned size) : counts(size + 1), subroutines(size + 1) {
+    start = Clock::now();
+    total = Clock::duration::zero();
+}
+
+void Profiler::enter(unsigned target) {
+    Frame frame = {target, Clock::now(), Clock::duration::zero()};
+    frames.push_back(frame);
+    subroutines[target].calls++;
+    subroutines[target].active++;
+}
+
+void Profiler::leave() {
+    if(frames.empty()) {
+        return;
+    }
+    Frame frame = frames.back();
+    frames.pop_back();
+    Clock::duration elapsed = Clock::now() - frame.start;
+    Subroutine &subroutine = subroutines[frame.target];
+
+    // A recursive subroutine only counts its outermost call as inclusive time
+    if(--subroutine.active == 0) {
+        subroutine.inclusive += elapsed;
+    }
+    subroutine.exclusive += elapsed - frame.callees;
+    if(!frames.empty()) {
+        frames.back().callees += elapsed;
+    }
+}
+
+void Profiler::finish() {
+    while(!frames.empty()) {
+        leave();
+    }
+    total = Clock::now() - start;
+}
+
+static double seconds(chrono::steady_clock::duration duration) {
+    return chrono::duration<double>(duration).count();
+}
+
+static double percentage(unsigned long long part, unsigned long long whole) {
+    return (whole > 0 ? 100.0 * part / whole : 0);
+}
+
+void Profiler::report(ostream &out, const Program &p, const string &listing) const {
+    unsigned size = p.size();
+    vector<string> lines(size);
+    istringstream input(listing);
+    for(unsigned pc = 0; pc < size && getline(input, lines[pc]); pc++);
+
+    // Instructions are attributed to the label they follow
+    unsigned long long executed = 0;
+    map<string, unsigned long long> opcodes;
+    map<string, unsigned long long> labels;
+    string label = "(start)";
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(p[pc].op == MARK) {
+            label = lines[pc];
+        }
+        executed += counts[pc];
+        opcodes[lines[pc].substr(0, lines[pc].find(' '))] += counts[pc];
+        labels[label] += counts[pc];
+    }
+
+    out << "Profile: " << executed << " instructions in " << seconds(total) << " s" << endl;
+    out << fixed << setprecision(1);
+
+    vector<pair<unsigned long long, string> > sorted;
+    for(auto &opcode : opcodes) {
+        if(opcode.second > 0) {
+            sorted.push_back(make_pair(opcode.second, opcode.first));
+        }
+    }
+    sort(sorted.rbegin(), sorted.rend());
+    out << endl << "Opcodes:" << endl;
+    for(auto &opcode : sorted) {
+        out << setw(16) << opcode.first << setw(7) << percentage(opcode.first, executed) << "%  " << opcode.second << endl;
+    }
+
+    sorted.clear();
+    for(auto &label : labels) {
+        if(label.second > 0) {
+            sorted.push_back(make_pair(label.second, label.first));
+        }
+    }
+    sort(sorted.rbegin(), sorted.rend());
+    out << endl << "Labels:" << endl;
+    for(auto &label : sorted) {
+        out << setw(16) << label.first << setw(7) << percentage(label.first, executed) << "%  " << label.second << endl;
+    }
+
+    vector<pair<Clock::duration, unsigned> > called;
+    for(unsigned target = 0; target <= size; target++) {
+        if(subroutines[target].calls > 0) {
+            called.push_back(make_pair(subroutines[target].inclusive, target));
+        }
+    }
+    sort(called.rbegin(), called.rend());
+    if(!called.empty()) {
+        out << endl << "Subroutines:" << setw(12) << "calls" << setw(16) << "inclusive (s)" << setw(16) << "exclusive (s)" << endl;
+        for(auto &entry : called) {
+            const Subroutine &subroutine = subroutines[entry.second];
+            string name = (entry.second > 0 && p[entry.second - 1].op == MARK ? lines[entry.second - 1] : "pc " + to_string(entry.second));
+            out << setw(24) << subroutine.calls << setprecision(6) << setw(16) << seconds(subroutine.inclusive)
+                << setw(16) << seconds(subroutine.exclusive) << "  " << name << endl;
+        }
+        out << setprecision(1);
+    }
+
+    vector<pair<unsigned long long, unsigned> > hottest;
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(counts[pc] > 0) {
+            hottest.push_back(make_pair(counts[pc], pc));
+        }
+    }
+    sort(hottest.begin(), hottest.end(), [](const pair<unsigned long long, unsigned> &a, const pair<unsigned long long, unsigned> &b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+    hottest.resize(min<size_t>(hottest.size(), HOTTEST));
+    out << endl << "Hottest instructions:" << endl;
+    for(auto &entry : hottest) {
+        out << setw(16) << entry.first << setw(7) << percentage(entry.first, executed) << "%  "
+            << setw(6) << entry.second << "  " << lines[entry.second] << endl;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <chrono>
+
+#include "Types.h"
+
+// Collects what the switch engine executes when run with --profile: a
+// counter per program counter, and the calls to every subroutine with the
+// time spent in them. Counts per opcode and per label are derived from the
+// counters when the report is made, so the engine does no more than
+// increment one counter per instruction. The engine only calls into the
+// Profiler in its profiling instantiation, the normal one is unchanged.
+class Profiler {
+    public:
+        Profiler(unsigned size);
+
+        void count(unsigned pc) {
+            counts[pc]++;
+        }
+
+        void enter(unsigned target); // On CALL
+        void leave(); // On ENDSUB
+        void finish(); // Closes the subroutines still running at the end
+
+        // Prints the report, using a listing from programToString to
+        // annotate the program counters
+        void report(std::ostream &, const Program &, const std::string &) const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Frame {
+            unsigned target;
+            Clock::time_point start;
+            Clock::duration callees; // Time spent in subroutines called from here
+        };
+
+        struct Subroutine {
+            unsigned long long calls;
+            unsigned active; // Frames on the call stack, for recursion
+            Clock::duration inclusive, exclusive;
+        };
+
+        std::vector<unsigned long long> counts;
+        std::vector<Subroutine> subroutines; // Indexed by the target
+        std::vector<Frame> frames;
+        Clock::time_point start;
+        Clock::duration total;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include "ProgramCache.h"
+
+using namespace std;
+
+ProgramCache::ProgramCache(size_t capacity) {
+    this->capacity = max(capacity, (size_t)1);
+}
+
+ProgramCache::Entry ProgramCache::find(uint64_t sourceHash) {
+    lock_guard<mutex> guard(lock);
+    auto found = entries.find(sourceHash);
+    if(found == entries.end()) {
+        return Entry();
+    }
+    order.splice(order.begin(), order, found->second);
+    return found->second->second;
+}
+
+// Two jobs may have compiled the same program at once, the first one stays
+void ProgramCache::insert(uint64_t sourceHash, Entry program) {
+    lock_guard<mutex> guard(lock);
+    if(entries.count(sourceHash) > 0) {
+        return;
+    }
+    if(order.size() == capacity) {
+        entries.erase(order.back().first);
+        order.pop_back();
+    }
+    order.push_front(make_pair(sourceHash, program));
+    entries[sourceHash] = order.begin();
+}
@@ -0,0 +1,35 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+#include "Verifier.h"
+
+// Verified programs kept in memory by the hash of their source, for --serve.
+// Once it holds capacity programs, adding one drops the program that was
+// used least recently. Programs are shared, so a dropped program stays
+// alive for the jobs still running it. Safe to use from several threads.
+class ProgramCache {
+    public:
+        typedef std::shared_ptr<const VerifiedProgram> Entry;
+
+        ProgramCache(size_t);
+        Entry find(uint64_t); // NULL if not cached
+        void insert(uint64_t, Entry);
+
+    private:
+        typedef std::list<std::pair<uint64_t, Entry> > Order; // Most recently used first
+
+        size_t capacity;
+        std::mutex lock;
+        Order order;
+        std::unordered_map<uint64_t, Order::iterator> entries;
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "Server.h"
+#include "SourceFile.h"
+#include "BytecodeCache.h"
+
+using namespace std;
+
+static const unsigned ACCEPT_RETRY = 100; // Milliseconds to wait after accept() failed
+
+// Sends all of it, without SIGPIPE if the other end has gone away
+static bool sendAll(int fd, const char *data, size_t size) {
+    while(size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if(sent < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static bool sendFrame(int fd, char tag, const char *data, size_t size) {
+    string header = tag + to_string(size) + "\n";
+    return sendAll(fd, header.data(), header.size()) && sendAll(fd, data, size);
+}
+
+// Reads exactly size bytes, false if the connection ends first
+static bool receiveAll(int fd, char *data, size_t size) {
+    while(size > 0) {
+        ssize_t length = read(fd, data, size);
+        if(length < 0 && errno == EINTR) {
+            continue;
+        }
+        if(length <= 0) {
+            return false;
+        }
+        data += length;
+        size -= length;
+    }
+    return true;
+}
+
+// Reads up to a newline, which is dropped, at most limit bytes
+static bool receiveLine(int fd, string &line, size_t limit) {
+    line.clear();
+    char character;
+    while(line.size() <= limit && receiveAll(fd, &character, 1)) {
+        if(character == '\n') {
+            return true;
+        }
+        line.push_back(character);
+    }
+    return false;
+}
+
+static sockaddr_un socketAddress(const string &path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw SocketException();
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return address;
+}
+
+// Program output, sent to the client as O frames
+class SocketSink: public Sink {
+    public:
+        SocketSink(int fd) : fd(fd) {}
+
+        void write(const char *data, size_t size) {
+            if(!sendFrame(fd, 'O', data, size)) {
+                throw OutputException();
+            }
+        }
+
+    private:
+        int fd;
+};
+
+Server::Server(const string &path, Compiler compiler, Engine engine, size_t heapLimit, unsigned threads, size_t cacheSize)
+    : path(path), compiler(compiler), engine(engine), heapLimit(heapLimit), threads(max(threads, 1U)), cache(cacheSize) {
+    sockaddr_un address = socketAddress(path);
+
+    // A socket left behind by an earlier server is replaced, anything else isn't
+    struct stat info;
+    if(lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path.c_str());
+    }
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0) {
+        throw SocketException();
+    }
+    // Clients can run any file the server can read, so the socket is
+    // created owner-only rather than restricted after it exists
+    mode_t mask = umask(0177);
+    int bound = bind(listener, (sockaddr *)&address, sizeof(address));
+    umask(mask);
+    if(bound != 0 || listen(listener, SOMAXCONN) != 0) {
+        close(listener);
+        throw SocketException();
+    }
+}
+
+void Server::run() {
+    cerr << "Serving on " << path << " with " << threads << " threads" << endl;
+    vector<thread> workers;
+    for(unsigned k = 0; k < threads; k++) {
+        workers.push_back(thread(&Server::serve, this));
+    }
+    for(thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void Server::serve() {
+    while(true) {
+        int client = accept(listener, NULL, NULL);
+        if(client < 0) {
+            int error = errno;
+            if(error != EINTR && error != ECONNABORTED) { // Like running out of file descriptors
+                {
+                    lock_guard<mutex> guard(logLock);
+                    cerr << "Warning: accepting a client failed: " << strerror(error) << endl;
+                }
+                this_thread::sleep_for(chrono::milliseconds(ACCEPT_RETRY));
+            }
+            continue;
+        }
+        handle(client);
+        close(client);
+    }
+}
+
+void Server::handle(int client) {
+    string programPath;
+    if(!receiveLine(client, programPath, PATH_MAX)) {
+        return;
+    }
+    try {
+        ProgramCache::Entry compiled = program(programPath);
+        FdSource input(client);
+        SocketSink output(client);
+        {
+            Interpreter interpreter(compiled, ValueStack::DEFAULT_CAPACITY, heapLimit);
+            interpreter.redirect(input, output);
+            interpreter.interpret(engine);
+        } // Flushes the last output
+        sendFrame(client, 'D', NULL, 0);
+    } catch(exception &e) {
+        string message = e.what();
+        if(!sendFrame(client, 'E', message.data(), message.size())) {
+            lock_guard<mutex> guard(logLock);
+            cerr << programPath << ": " << message << endl; // The client has gone away
+        }
+    }
+}
+
+// Compiles the program unless its source is cached. Two threads may
+// compile the same source at once, which is rare enough not to wait.
+ProgramCache::Entry Server::program(const string &programPath) {
+    SourceFile source(programPath);
+    uint64_t sourceHash = BytecodeCache::hash(source.data(), source.size());
+    ProgramCache::Entry compiled = cache.find(sourceHash);
+    if(!compiled) {
+        compiled = Interpreter::verify(compiler(source.data(), source.size()));
+        cache.insert(sourceHash, compiled);
+    }
+    return compiled;
+}
+
+int Server::request(const string &socketPath, const string &programPath) {
+    sockaddr_un address = socketAddress(socketPath);
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(server < 0 || connect(server, (sockaddr *)&address, sizeof(address)) != 0) {
+        throw SocketException();
+    }
+
+    // The server has another working directory
+    char *resolved = realpath(programPath.c_str(), NULL);
+    string request = (resolved != NULL ? string(resolved) : programPath) + "\n";
+    free(resolved);
+    if(!sendAll(server, request.data(), request.size())) {
+        throw ConnectionException();
+    }
+
+    // Input is passed on while the output comes back; the thread is left
+    // behind if the program ends before its input does
+    thread([server]() {
+        char buffer[Console::BUFFER_SIZE];
+        ssize_t length;
+        while((length = read(0, buffer, sizeof(buffer))) > 0 || (length < 0 && errno == EINTR)) {
+            if(length > 0 && !sendAll(server, buffer, length)) {
+                break;
+            }
+        }
+        shutdown(server, SHUT_WR);
+    }).detach();
+
+    FdSink output(1);
+    string header, payload;
+    while(receiveLine(server, header, 32) && !header.empty()) {
+        payload.resize(strtoull(header.c_str() + 1, NULL, 10));
+        if(!receiveAll(server, &payload[0], payload.size())) {
+            break;
+        }
+        if(header[0] == 'O') {
+            output.write(payload.data(), payload.size());
+        } else if(header[0] == 'E') {
+            cerr << payload << endl;
+            return 1;
+        } else if(header[0] == 'D') {
+            return 0;
+        }
+    }
+    throw ConnectionException();
+}
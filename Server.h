@@ -0,0 +1,54 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <mutex>
+#include <functional>
+#include <cstddef>
+
+#include "Interpreter.h"
+#include "ProgramCache.h"
+#include "Exceptions.h"
+
+// Keeps running with --serve and runs programs for clients that connect to
+// a Unix domain socket, so a program that is run over and over is decoded,
+// optimized and linked only once. Each of the threads accepts and serves
+// one client at a time.
+//
+// A client sends the absolute path of the program and a newline, then the
+// input of the program until it shuts down its end for writing. The server
+// answers with frames of a tag, the length of the payload in decimal, a
+// newline and the payload:
+//   O  output of the program, as soon as the program flushes it
+//   E  the error the program or its source failed with, which ends it
+//   D  the program has ended
+//
+// Programs are cached by the hash of their source, so a changed file is
+// compiled again and an unchanged file at another path isn't.
+class Server {
+    public:
+        typedef std::function<Program(const char *, size_t)> Compiler; // The source to a linked program
+
+        Server(const std::string &, Compiler, Engine, size_t, unsigned, size_t);
+        void run(); // Doesn't return
+
+        // Runs the program at the path on the server behind the socket, with
+        // standard input and output. Returns the exit status for main().
+        static int request(const std::string &, const std::string &);
+
+    private:
+        std::string path;
+        Compiler compiler;
+        Engine engine;
+        size_t heapLimit;
+        unsigned threads;
+        ProgramCache cache;
+        int listener;
+        std::mutex logLock;
+
+        void serve();
+        void handle(int);
+        ProgramCache::Entry program(const std::string &);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SourceFile.h"
+
+using namespace std;
+
+SourceFile::SourceFile(const string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw FileNotFoundException();
+    }
+
+    contents = NULL;
+    length = 0;
+    mapped = false;
+
+    struct stat info;
+    if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *memory = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(memory != MAP_FAILED) {
+            madvise(memory, info.st_size, MADV_SEQUENTIAL); // Parsed front to back once
+            contents = (const char *)memory;
+            length = info.st_size;
+            mapped = true;
+        }
+    }
+
+    if(!mapped) {
+        char block[64 * 1024];
+        ssize_t count;
+        while((count = read(fd, block, sizeof(block))) > 0) {
+            buffer.append(block, count);
+        }
+        contents = buffer.data();
+        length = buffer.size();
+    }
+    close(fd);
+}
+
+SourceFile::~SourceFile() {
+    if(mapped) {
+        munmap((void *)contents, length);
+    }
+}
+
+const char *SourceFile::data() const {
+    return contents;
+}
+
+size_t SourceFile::size() const {
+    return length;
+}
@@ -0,0 +1,30 @@
+#ifndef SOURCEFILE_H
+#define SOURCEFILE_H
+
+#include <string>
+#include <cstddef>
+
+#include "Exceptions.h"
+
+// A Whitespace source file, mapped into memory read-only so the parser can
+// decode it without copying. Files that can't be mapped, like pipes, are
+// read into memory instead.
+class SourceFile {
+    public:
+        SourceFile(const std::string &);
+        ~SourceFile();
+
+        const char *data() const;
+        size_t size() const;
+
+    private:
+        const char *contents;
+        size_t length;
+        bool mapped;
+        std::string buffer; // Holds the contents when the file isn't mapped
+
+        SourceFile(const SourceFile &);
+        SourceFile &operator=(const SourceFile &);
+};
+
+#endif
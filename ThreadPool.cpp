@@ -0,0 +1,62 @@
+#include <thread>
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned threads) {
+    for(unsigned k = 0; k < max(threads, 1U); k++) {
+        queues.push_back(unique_ptr<Queue>(new Queue));
+    }
+    next = 0;
+}
+
+// Spreads the tasks over the queues round-robin
+void ThreadPool::submit(Task task) {
+    Queue &queue = *queues[next];
+    next = (next + 1) % queues.size();
+    lock_guard<mutex> guard(queue.lock);
+    queue.tasks.push_back(move(task));
+}
+
+void ThreadPool::run() {
+    vector<thread> threads;
+    for(unsigned worker = 1; worker < queues.size(); worker++) {
+        threads.push_back(thread(&ThreadPool::work, this, worker));
+    }
+    work(0); // The calling thread is worker 0
+    for(thread &worker : threads) {
+        worker.join();
+    }
+}
+
+unsigned ThreadPool::threadCount() const {
+    return queues.size();
+}
+
+// Own queue first, newest task first, then the oldest task of the others
+bool ThreadPool::take(unsigned worker, Task &task) {
+    for(unsigned k = 0; k < queues.size(); k++) {
+        Queue &queue = *queues[(worker + k) % queues.size()];
+        lock_guard<mutex> guard(queue.lock);
+        if(!queue.tasks.empty()) {
+            if(k == 0) {
+                task = move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// No new tasks are added while running, so empty queues mean the end
+void ThreadPool::work(unsigned worker) {
+    Task task;
+    while(take(worker, task)) {
+        task();
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+// Runs a set of tasks on a fixed number of threads. Every thread has its
+// own queue and takes tasks from the back of it; a thread that runs out
+// steals from the front of the other queues, so long tasks don't leave the
+// other threads idle. Tasks are submitted up front and run() returns once
+// all of them are done.
+class ThreadPool {
+    public:
+        typedef std::function<void()> Task;
+
+        ThreadPool(unsigned);
+        void submit(Task);
+        void run();
+        unsigned threadCount() const;
+
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue> > queues;
+        unsigned next; // Queue that gets the next submitted task
+
+        bool take(unsigned, Task &);
+        void work(unsigned);
+};
+
+#endif
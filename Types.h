@@ -1,22 +1,90 @@
 #ifndef TYPES_H
 #define TYPES_H
 
-enum Instruction {
+#include <vector>
+#include <string>
+
+#include "Cell.h"
+
+enum Opcode {
     PUSH, DUP, COPY, SWAP, DISCARD, SLIDE, // Stack manipulations
     ADD, SUB, MUL, DIV, MOD, // Arithmetic operations
     STORE, RETRIEVE, // Heap access
     MARK, CALL, JUMP, JUMPZERO, JUMPNEG, ENDSUB, ENDPROG, // Flow control
-    WRITEC, WRITEN, READC, READN // I/O operations
+    WRITEC, WRITEN, READC, READN, // I/O operations
+
+    // Superinstructions produced by the Optimizer, taking an immediate argument
+    PUSHADD, PUSHSUB, PUSHMUL, // PUSH n; ADD/SUB/MUL
+    PUSHRETRIEVE, // PUSH a; RETRIEVE
+    PUSHSTORE, // PUSH a; SWAP; STORE
+    PUSHWRITEC, // PUSH c; WRITEC
+    DUPJUMPZERO, DUPJUMPNEG, // DUP; JUMPZERO/JUMPNEG
+
+    // Loop idioms recognized by the Optimizer. Each is put in front of the
+    // loop it replaces, which stays in place for when the idiom can't run.
+    WRITESTRING, // Writes the string at an address up to a zero
+    FILLHEAP, // Stores a value in a range of addresses
+    COPYHEAP // Copies a range of addresses to another
 };
 
 enum Token {
     LINEFEED, SPACE, TAB
 };
 
-enum Mode {
-    STACKMANIP, ARITH, HEAPACC, FLOWCONT, IO
+// A decoded instruction. Every instruction has the same size, whether or
+// not it takes an argument, so the program is a flat array that can be
+// indexed by the program counter directly.
+struct Instruction {
+    Opcode op;
+    unsigned target; // Index to branch to, filled in by the Linker
+    Cell arg; // Number for PUSH, COPY and SLIDE, label for flow control
+
+    Instruction(Opcode op, Cell arg = Cell()) : op(op), target(0), arg(arg) {}
 };
 
 typedef std::vector<Instruction> Program;
 
+// Labels are positive numbers, see Parser::parseLabel, so they are ordered
+// by value: small ones by their word, the ones past a word by their digits
+struct LabelOrder {
+    bool operator()(const Cell &a, const Cell &b) const {
+        if(a.isSmall() || b.isSmall()) {
+            return a.isSmall() && (!b.isSmall() || a.small() < b.small());
+        }
+        std::string x = a.toString(), y = b.toString();
+        return x.size() < y.size() || (x.size() == y.size() && x < y);
+    }
+};
+
+inline bool sameLabel(const Cell &a, const Cell &b) {
+    return !LabelOrder()(a, b) && !LabelOrder()(b, a);
+}
+
+// Whether the instruction carries a number or label argument
+inline bool hasArgument(Opcode op) {
+    switch(op) {
+        case PUSH: case COPY: case SLIDE: case MARK:
+        case CALL: case JUMP: case JUMPZERO: case JUMPNEG:
+        case PUSHADD: case PUSHSUB: case PUSHMUL:
+        case PUSHRETRIEVE: case PUSHSTORE: case PUSHWRITEC:
+        case DUPJUMPZERO: case DUPJUMPNEG:
+        case WRITESTRING: case FILLHEAP: case COPYHEAP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Whether the instruction branches to a label resolved by the Linker
+inline bool isBranch(Opcode op) {
+    switch(op) {
+        case CALL: case JUMP: case JUMPZERO: case JUMPNEG:
+        case DUPJUMPZERO: case DUPJUMPNEG:
+        case WRITESTRING: case FILLHEAP: case COPYHEAP: // To the end of the loop
+            return true;
+        default:
+            return false;
+    }
+}
+
 #endif
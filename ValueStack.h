@@ -0,0 +1,79 @@
+#ifndef VALUESTACK_H
+#define VALUESTACK_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+#include "Cell.h"
+#include "Exceptions.h"
+
+// Contiguous operand stack. The top of the stack is the last element of
+// the vector, so PUSH and POP never allocate once the reserved capacity is
+// large enough, and COPY/SLIDE are a single index computation. Every
+// engine, the JIT included, stops a program at LIMIT values.
+class ValueStack {
+    public:
+        static const size_t DEFAULT_CAPACITY = 1024;
+        static const size_t LIMIT = 16 * 1024 * 1024;
+
+        ValueStack(size_t capacity = DEFAULT_CAPACITY) {
+            cells.reserve(capacity);
+        }
+
+        void reserve(size_t capacity) {
+            cells.reserve(capacity);
+        }
+
+        void push(const Cell &value) {
+            if(cells.size() == LIMIT) {
+                throw StackOverflowException();
+            }
+            cells.push_back(value);
+        }
+
+        Cell pop() {
+            Cell value = std::move(cells.back());
+            cells.pop_back();
+            return value;
+        }
+
+        Cell &top() {
+            return cells.back();
+        }
+
+        // Returns the n-th element counted from the top (0 is the top)
+        Cell &peek(size_t n) {
+            return cells[cells.size() - 1 - n];
+        }
+
+        void swap() {
+            size_t size = cells.size();
+            std::swap(cells[size - 1], cells[size - 2]);
+        }
+
+        // Removes n elements below the top, keeping the top element
+        void slide(size_t n) {
+            Cell value = std::move(cells.back());
+            cells.resize(cells.size() - n);
+            cells.back() = std::move(value);
+        }
+
+        // Returns the n-th element counted from the bottom
+        const Cell &operator[](size_t n) const {
+            return cells[n];
+        }
+
+        size_t size() const {
+            return cells.size();
+        }
+
+        bool empty() const {
+            return cells.empty();
+        }
+
+    private:
+        std::vector<Cell> cells;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include <climits>
+#include <algorithm>
+
+#include "Verifier.h"
+
+using namespace std;
+
+static const unsigned long UNKNOWN = ULONG_MAX; // Not reached (yet)
+
+// Depth an instruction needs and how it changes the depth. Arguments that
+// make no sense as a depth need more than any stack can have.
+static void stackEffect(const Instruction &in, unsigned long &needs, long &change) {
+    unsigned long n = (in.arg.isSmall() && !in.arg.isNegative() && in.arg.small() < UINT_MAX ? in.arg.small() : UINT_MAX - 1);
+    switch(in.op) {
+        case PUSH: case PUSHRETRIEVE: needs = 0; change = 1; break;
+        case DUP: needs = 1; change = 1; break;
+        case COPY: needs = n + 1; change = 1; break;
+        case SWAP: needs = 2; change = 0; break;
+        case SLIDE: needs = n + 1; change = -(long)n; break;
+        case ADD: case SUB: case MUL: case DIV: case MOD: needs = 2; change = -1; break;
+        case STORE: needs = 2; change = -2; break;
+        case RETRIEVE: case PUSHADD: case PUSHSUB: case PUSHMUL: needs = 1; change = 0; break;
+        case DUPJUMPZERO: case DUPJUMPNEG: needs = 1; change = 0; break;
+        case WRITESTRING: case COPYHEAP: needs = 1; change = 0; break; // WRITESTRING leaves one more when done
+        case FILLHEAP: needs = 2; change = 0; break;
+        case DISCARD: case JUMPZERO: case JUMPNEG: case PUSHSTORE: needs = 1; change = -1; break;
+        case WRITEC: case WRITEN: case READC: case READN: needs = 1; change = -1; break;
+        default: needs = 0; change = 0; break; // Flow control and PUSHWRITEC
+    }
+}
+
+// Output, input and stores can't be taken back, so they end a block: an
+// underflow after them is only reported once they have happened
+static bool hasSideEffect(Opcode op) {
+    switch(op) {
+        case STORE: case PUSHSTORE:
+        case WRITEC: case WRITEN: case PUSHWRITEC: case READC: case READN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool endsBlock(Opcode op) {
+    return isBranch(op) || op == ENDSUB || op == ENDPROG || hasSideEffect(op);
+}
+
+Verifier::Verifier() {
+    blocks = checked = 0;
+}
+
+vector<unsigned> Verifier::verify(const Program &p) {
+    unsigned size = p.size();
+
+    // Blocks start at the beginning, at branch targets, and after branches
+    // and instructions with side effects
+    vector<bool> leader(size + 1, false);
+    leader[0] = true;
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(isBranch(p[pc].op)) {
+            leader[p[pc].target] = true;
+        }
+        if(endsBlock(p[pc].op)) {
+            leader[pc + 1] = true;
+        }
+    }
+    vector<unsigned> starts, blockAt(size + 1);
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(leader[pc]) {
+            starts.push_back(pc);
+        }
+        blockAt[pc] = starts.size() - 1;
+    }
+    blocks = starts.size();
+    starts.push_back(size);
+
+    // What every block needs on entry, and what it does to the depth
+    vector<unsigned long> needs(blocks);
+    vector<long> changes(blocks);
+    unsigned long most = 0;
+    for(unsigned block = 0; block < blocks; block++) {
+        long depth = 0;
+        unsigned long blockNeeds = 0;
+        for(unsigned pc = starts[block]; pc < starts[block + 1]; pc++) {
+            unsigned long needs;
+            long change;
+            stackEffect(p[pc], needs, change);
+            if((long)needs > depth) {
+                blockNeeds = max(blockNeeds, needs - depth);
+            }
+            depth += change;
+        }
+        needs[block] = blockNeeds;
+        changes[block] = depth;
+        most = max(most, blockNeeds);
+    }
+
+    // The least depth each block can start with, over all paths to it.
+    // Anything from the deepest need up is as good as infinite, which
+    // keeps loops that grow the stack from running forever.
+    vector<unsigned long> guaranteed(blocks, UNKNOWN);
+    vector<unsigned> work;
+    auto reach = [&](unsigned pc, unsigned long depth) {
+        if(pc >= size) {
+            return;
+        }
+        unsigned block = blockAt[pc];
+        depth = min(depth, most);
+        if(guaranteed[block] == UNKNOWN || depth < guaranteed[block]) {
+            guaranteed[block] = depth;
+            work.push_back(block);
+        }
+    };
+    reach(0, 0);
+    for(unsigned pc = 0; pc < size; pc++) {
+        if(p[pc].op == CALL) {
+            reach(pc + 1, 0);
+        }
+    }
+    while(!work.empty()) {
+        unsigned block = work.back();
+        work.pop_back();
+        long exit = (long)max(guaranteed[block], needs[block]) + changes[block];
+        unsigned long depth = (exit < 0 ? 0 : exit);
+        const Instruction &last = p[starts[block + 1] - 1];
+
+        if(isBranch(last.op)) {
+            reach(last.target, depth);
+        }
+        if(last.op != JUMP && last.op != CALL && last.op != ENDSUB && last.op != ENDPROG) {
+            reach(starts[block + 1], depth); // Falls through
+        }
+    }
+
+    // Unreachable blocks are checked too, it costs nothing
+    vector<unsigned> checks(size + 1, 0);
+    checked = 0;
+    for(unsigned block = 0; block < blocks; block++) {
+        if(needs[block] > 0 && (guaranteed[block] == UNKNOWN || guaranteed[block] < needs[block])) {
+            checks[starts[block]] = min(needs[block], (unsigned long)UINT_MAX);
+            checked++;
+        }
+    }
+    return checks;
+}
+
+unsigned Verifier::blockCount() const {
+    return blocks;
+}
+
+unsigned Verifier::checkedCount() const {
+    return checked;
+}
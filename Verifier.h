@@ -0,0 +1,42 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <vector>
+
+#include "Types.h"
+
+// A linked program with the depth checks the Verifier found for it, which
+// Interpreters can share instead of each verifying their own copy
+struct VerifiedProgram {
+    Program program;
+    std::vector<unsigned> depthChecks;
+};
+
+// Works out where the engines have to check the depth of the value stack,
+// so no single instruction has to. The linked program is split into basic
+// blocks, and for every block the depth it needs on entry is computed: the
+// most any instruction in it reaches below the depth the block started
+// with. A forward pass over the control-flow graph then finds the depth
+// every block is guaranteed to start with. Blocks that are guaranteed
+// enough need no check at all; the others are checked once on entry.
+//
+// The depth after a CALL depends on the subroutine, so the instruction
+// after a CALL starts a block that knows nothing about the depth. Stores
+// and I/O end a block too, so what they do happens before an underflow
+// later on is reported, as if every instruction was checked.
+class Verifier {
+    public:
+        Verifier();
+
+        // The depth to check for at the start of every block, indexed by
+        // pc; 0 where no check is needed, which includes the rest of a block
+        std::vector<unsigned> verify(const Program &);
+        unsigned blockCount() const;
+        unsigned checkedCount() const; // Blocks that still need a check
+
+    private:
+        unsigned blocks;
+        unsigned checked;
+};
+
+#endif
@@ -0,0 +1,236 @@
+/* Runtime for C programs generated with whitespace --emit-c.
+ * Provides the value stack, the heap, the return-address table for
+ * CALL/ENDSUB and the I/O operations. Everything is static inline, so the
+ * C compiler can optimize it together with the generated code. */
+#ifndef WHITESPACE_RUNTIME_H
+#define WHITESPACE_RUNTIME_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+static long *ws_stack, **ws_heap;
+static size_t ws_stack_size, ws_stack_capacity, ws_heap_size; /* Heap size in pages */
+static unsigned *ws_returns; /* Index of the CALL to return to */
+static size_t ws_returns_size, ws_returns_capacity;
+
+static void ws_error(const char *message) {
+    fflush(stdout);
+    fprintf(stderr, "Error: %s\n", message);
+    exit(1);
+}
+
+static void *ws_grow(void *memory, size_t *capacity, size_t element) {
+    *capacity = (*capacity == 0 ? 1024 : *capacity * 2);
+    memory = realloc(memory, *capacity * element);
+    if(memory == NULL) {
+        ws_error("out of memory.");
+    }
+    return memory;
+}
+
+static inline void ws_push(long value) {
+    if(ws_stack_size == ws_stack_capacity) {
+        ws_stack = (long *)ws_grow(ws_stack, &ws_stack_capacity, sizeof(long));
+    }
+    ws_stack[ws_stack_size++] = value;
+}
+
+static inline long ws_pop(void) {
+    if(ws_stack_size == 0) {
+        ws_error("the value stack is empty.");
+    }
+    return ws_stack[--ws_stack_size];
+}
+
+static inline long *ws_peek(long n) {
+    if(n < 0 || (size_t)n >= ws_stack_size) {
+        ws_error("index out of bounds.");
+    }
+    return &ws_stack[ws_stack_size - 1 - n];
+}
+
+static inline void ws_slide(long n) {
+    long top = ws_pop();
+    if(n < 0 || (size_t)n > ws_stack_size) {
+        ws_error("index out of bounds.");
+    }
+    ws_stack_size -= n;
+    ws_push(top);
+}
+
+/* The heap is made of pages allocated on first store, like the interpreter's,
+ * so memory use follows the touched addresses. Untouched cells read as 0.
+ * Pages below WS_DIRECT_PAGES are found in a flat directory, the few beyond
+ * that in a hash table with linear probing. */
+#define WS_PAGE_BITS 12
+#define WS_PAGE_SIZE (1L << WS_PAGE_BITS)
+#define WS_DIRECT_PAGES (1L << 20)
+
+static long *ws_distant_keys, **ws_distant_pages; /* Page numbers and pages */
+static size_t ws_distant_size, ws_distant_capacity;
+
+/* The slot of the page, or the empty slot where it belongs */
+static size_t ws_distant_slot(long page) {
+    size_t slot = ((unsigned long)page * 0x9e3779b97f4a7c15UL) & (ws_distant_capacity - 1);
+    while(ws_distant_pages[slot] != NULL && ws_distant_keys[slot] != page) {
+        slot = (slot + 1) & (ws_distant_capacity - 1);
+    }
+    return slot;
+}
+
+static long *ws_distant_page(long page, int create) {
+    size_t slot, k, capacity;
+    long *keys, **pages;
+    if(ws_distant_capacity > 0) {
+        slot = ws_distant_slot(page);
+        if(ws_distant_pages[slot] != NULL || !create) {
+            return ws_distant_pages[slot];
+        }
+    } else if(!create) {
+        return NULL;
+    }
+    if(2 * (ws_distant_size + 1) > ws_distant_capacity) { /* Keep it at most half full */
+        keys = ws_distant_keys;
+        pages = ws_distant_pages;
+        capacity = ws_distant_capacity;
+        ws_distant_capacity = (capacity == 0 ? 16 : capacity * 2);
+        ws_distant_keys = (long *)calloc(ws_distant_capacity, sizeof(long));
+        ws_distant_pages = (long **)calloc(ws_distant_capacity, sizeof(long *));
+        if(ws_distant_keys == NULL || ws_distant_pages == NULL) {
+            ws_error("out of memory.");
+        }
+        for(k = 0; k < capacity; k++) {
+            if(pages[k] != NULL) {
+                slot = ws_distant_slot(keys[k]);
+                ws_distant_keys[slot] = keys[k];
+                ws_distant_pages[slot] = pages[k];
+            }
+        }
+        free(keys);
+        free(pages);
+    }
+    slot = ws_distant_slot(page);
+    ws_distant_keys[slot] = page;
+    if((ws_distant_pages[slot] = (long *)calloc(WS_PAGE_SIZE, sizeof(long))) == NULL) {
+        ws_error("out of memory.");
+    }
+    ws_distant_size++;
+    return ws_distant_pages[slot];
+}
+
+static inline void ws_store(long address, long value) {
+    long page = address >> WS_PAGE_BITS;
+    if(address < 0) {
+        ws_error("index out of bounds.");
+    }
+    if(page >= WS_DIRECT_PAGES) {
+        ws_distant_page(page, 1)[address & (WS_PAGE_SIZE - 1)] = value;
+        return;
+    }
+    if((size_t)page >= ws_heap_size) {
+        size_t size = page + 1;
+        ws_heap = (long **)realloc(ws_heap, size * sizeof(long *));
+        if(ws_heap == NULL) {
+            ws_error("out of memory.");
+        }
+        memset(ws_heap + ws_heap_size, 0, (size - ws_heap_size) * sizeof(long *));
+        ws_heap_size = size;
+    }
+    if(ws_heap[page] == NULL && (ws_heap[page] = (long *)calloc(WS_PAGE_SIZE, sizeof(long))) == NULL) {
+        ws_error("out of memory.");
+    }
+    ws_heap[page][address & (WS_PAGE_SIZE - 1)] = value;
+}
+
+static inline long ws_retrieve(long address) {
+    long page = address >> WS_PAGE_BITS;
+    long *distant;
+    if(address < 0) {
+        ws_error("index out of bounds.");
+    }
+    if(page >= WS_DIRECT_PAGES) {
+        distant = ws_distant_page(page, 0);
+        return (distant == NULL ? 0 : distant[address & (WS_PAGE_SIZE - 1)]);
+    }
+    if((size_t)page >= ws_heap_size || ws_heap[page] == NULL) {
+        return 0;
+    }
+    return ws_heap[page][address & (WS_PAGE_SIZE - 1)];
+}
+
+static inline void ws_call(unsigned site) {
+    if(ws_returns_size == ws_returns_capacity) {
+        ws_returns = (unsigned *)ws_grow(ws_returns, &ws_returns_capacity, sizeof(unsigned));
+    }
+    ws_returns[ws_returns_size++] = site;
+}
+
+static inline unsigned ws_return(void) {
+    if(ws_returns_size == 0) {
+        ws_error("ENDSUB without a matching CALL.");
+    }
+    return ws_returns[--ws_returns_size];
+}
+
+static inline long ws_add(long a, long b) {
+    long result;
+    if(__builtin_add_overflow(a, b, &result)) {
+        ws_error("integer overflow.");
+    }
+    return result;
+}
+
+static inline long ws_sub(long a, long b) {
+    long result;
+    if(__builtin_sub_overflow(a, b, &result)) {
+        ws_error("integer overflow.");
+    }
+    return result;
+}
+
+static inline long ws_mul(long a, long b) {
+    long result;
+    if(__builtin_mul_overflow(a, b, &result)) {
+        ws_error("integer overflow.");
+    }
+    return result;
+}
+
+static inline long ws_divide(long a, long b, int modulo) {
+    if(b == 0) {
+        ws_error("division by zero.");
+    }
+    if(b == -1 && a == LONG_MIN) { /* Traps in hardware, for the remainder too */
+        if(modulo) {
+            return 0;
+        }
+        ws_error("integer overflow.");
+    }
+    return (modulo ? a % b : a / b);
+}
+
+static inline void ws_writec(long value) {
+    putchar((int)value);
+}
+
+static inline void ws_writen(long value) {
+    printf("%ld", value);
+}
+
+static inline long ws_readc(void) {
+    fflush(stdout);
+    return getchar();
+}
+
+static inline long ws_readn(void) {
+    long value = 0;
+    fflush(stdout);
+    if(scanf("%ld", &value) != 1) {
+        ws_error("no number could be read.");
+    }
+    return value;
+}
+
+#endif
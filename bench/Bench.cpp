@@ -0,0 +1,189 @@
+// Runs the bundled workloads with every engine and reports parse
+// throughput, instructions per second and peak memory use. With --save the
+// results are written to a baseline file, with --baseline they are
+// compared against one.
+//
+// The workloads in bench/workloads are:
+//   arith.ws      a tight loop over ADD, SUB, MUL, DIV, MOD and the heap
+//   recursion.ws  naive recursive Fibonacci through CALL/ENDSUB
+//   sort.ws       insertion sort of 3000 numbers on the heap
+//   print.ws      prints two million numbers, output bound
+//   comments.ws   sort.ws buried in 64 MB of comments, generated on the fly
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+#include <random>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "../Parser.h"
+#include "../SourceFile.h"
+
+using namespace std;
+
+static const char *WORKLOADS[] = {"arith", "recursion", "sort", "print", "comments"};
+static const char *ENGINES[] = {"switch", "threaded", "cached", "jit"};
+static const size_t COMMENT_SOURCE_SIZE = 64 * 1024 * 1024;
+
+struct Result {
+    double seconds;
+    double rate; // Instructions per second, or MB per second for parsing
+    long rssKilobytes;
+};
+
+// Buries a program in comments, keeping every token in order
+static void generateComments(const string &from, const string &to) {
+    SourceFile source(from);
+    string program(source.data(), source.size()), output;
+    size_t filler = COMMENT_SOURCE_SIZE / max((size_t)1, program.size());
+    mt19937 random(7);
+    uniform_int_distribution<int> letter('a', 'z');
+
+    output.reserve(COMMENT_SOURCE_SIZE + program.size());
+    for(char token : program) {
+        for(size_t k = 0; k < filler; k++) {
+            output.push_back((char)letter(random));
+        }
+        output.push_back(token);
+    }
+    ofstream(to.c_str(), ios::binary) << output;
+}
+
+static Result measureParse(const string &path) {
+    SourceFile source(path);
+    Parser parser;
+    double fastest = 1e9;
+
+    for(int round = 0; round < 3; round++) {
+        auto start = chrono::steady_clock::now();
+        Program program = parser.parse(source.data(), source.size());
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        fastest = min(fastest, elapsed.count());
+    }
+    Result result = {fastest, source.size() / fastest / (1024 * 1024), 0};
+    return result;
+}
+
+// Runs the interpreter on a workload, with the output thrown away. The
+// instruction count is read from --stats, which the switch engine reports.
+static Result measureRun(const string &path, const string &engine, unsigned long long &instructions) {
+    int errors[2];
+    if(pipe(errors) != 0) {
+        throw runtime_error("pipe failed");
+    }
+    auto start = chrono::steady_clock::now();
+    pid_t child = fork();
+    if(child == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, 1);
+        dup2(errors[1], 2);
+        close(errors[0]);
+        string option = "--engine=" + engine;
+        execl("./whitespace", "whitespace", "--no-cache", "--stats", option.c_str(), path.c_str(), (char *)NULL);
+        _exit(127);
+    }
+    close(errors[1]);
+
+    string report;
+    char buffer[4096];
+    ssize_t length;
+    while((length = read(errors[0], buffer, sizeof(buffer))) > 0) {
+        report.append(buffer, length);
+    }
+    close(errors[0]);
+
+    int status;
+    struct rusage usage;
+    wait4(child, &status, 0, &usage);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw runtime_error(path + " failed with --engine=" + engine + ": " + report);
+    }
+
+    unsigned long long counted = strtoull(report.c_str(), NULL, 10);
+    if(counted > 0) {
+        instructions = counted;
+    }
+    Result result = {elapsed.count(), instructions / elapsed.count(), usage.ru_maxrss};
+    return result;
+}
+
+static map<string, Result> readBaseline(const string &path) {
+    map<string, Result> baseline;
+    ifstream input(path.c_str());
+    string key;
+    Result result;
+    while(input >> key >> result.seconds >> result.rate >> result.rssKilobytes) {
+        baseline[key] = result;
+    }
+    return baseline;
+}
+
+static string compare(const map<string, Result> &baseline, const string &key, const Result &result) {
+    auto found = baseline.find(key);
+    if(found == baseline.end() || found->second.rate <= 0) {
+        return "";
+    }
+    ostringstream change;
+    change << showpos << fixed << setprecision(1) << (result.rate / found->second.rate - 1) * 100 << "%";
+    return change.str();
+}
+
+int main(int argc, char *argv[]) {
+    string savePath, baselinePath;
+    for(int k = 1; k + 1 < argc; k += 2) {
+        string option = argv[k];
+        if(option == "--save") {
+            savePath = argv[k + 1];
+        } else if(option == "--baseline") {
+            baselinePath = argv[k + 1];
+        }
+    }
+    map<string, Result> baseline = readBaseline(baselinePath), results;
+
+    generateComments("bench/workloads/sort.ws", "bench/workloads/comments.ws");
+
+    cout << left << setw(11) << "workload" << setw(10) << "engine" << right << setw(9) << "time (s)"
+         << setw(14) << "rate" << setw(11) << "peak RSS" << setw(10) << "vs base" << endl;
+    try {
+        for(const char *workload : WORKLOADS) {
+            string path = string("bench/workloads/") + workload + ".ws";
+            unsigned long long instructions = 0;
+
+            Result parse = measureParse(path);
+            results[string(workload) + "/parse"] = parse;
+            cout << left << setw(11) << workload << setw(10) << "parse" << right << fixed << setprecision(4)
+                 << setw(9) << parse.seconds << setprecision(1) << setw(9) << parse.rate << " MB/s"
+                 << setw(11) << "" << setw(10) << compare(baseline, string(workload) + "/parse", parse) << endl;
+
+            for(const char *engine : ENGINES) {
+                Result run = measureRun(path, engine, instructions);
+                string key = string(workload) + "/" + engine;
+                results[key] = run;
+                cout << left << setw(11) << workload << setw(10) << engine << right << fixed << setprecision(4)
+                     << setw(9) << run.seconds << setprecision(1) << setw(9) << run.rate / 1e6 << " Mi/s"
+                     << setw(8) << run.rssKilobytes / 1024 << " MB" << setw(10) << compare(baseline, key, run) << endl;
+            }
+        }
+    } catch(exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    if(!savePath.empty()) {
+        ofstream output(savePath.c_str());
+        for(auto &result : results) {
+            output << result.first << " " << result.second.seconds << " " << result.second.rate << " "
+                   << result.second.rssKilobytes << endl;
+        }
+        cout << "Saved the results to " << savePath << endl;
+    }
+    return 0;
+}
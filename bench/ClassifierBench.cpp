@@ -0,0 +1,66 @@
+// Measures how fast the Classifier compacts sources with different amounts
+// of comments, for every level the CPU supports.
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "../Classifier.h"
+
+using namespace std;
+
+static const size_t SOURCE_SIZE = 64 * 1024 * 1024;
+static const int ROUNDS = 5;
+
+// A source where the given percentage of bytes are comments
+static string makeSource(int commentPercentage) {
+    static const char tokens[] = {' ', '\t', '\n'};
+    static const char comments[] = "abcdefghijklmnopqrstuvwxyz.,;()";
+    mt19937 random(commentPercentage);
+    uniform_int_distribution<int> percent(0, 99), token(0, 2), comment(0, sizeof(comments) - 2);
+    string source(SOURCE_SIZE, ' ');
+
+    for(size_t k = 0; k < SOURCE_SIZE; k++) {
+        source[k] = (percent(random) < commentPercentage ? comments[comment(random)] : tokens[token(random)]);
+    }
+    return source;
+}
+
+int main() {
+    const int densities[] = {0, 50, 90, 99, 100};
+    vector<unsigned char> tokens(SOURCE_SIZE), expectedTokens;
+    Classifier::Level best = Classifier::detect();
+
+    cout << "comments  level    MB/s" << endl;
+    for(int density : densities) {
+        string source = makeSource(density);
+
+        for(int level = Classifier::SCALAR; level <= best; level++) {
+            Classifier classifier((Classifier::Level)level);
+            double fastest = 0;
+            size_t count = 0;
+
+            for(int round = 0; round < ROUNDS; round++) {
+                auto start = chrono::steady_clock::now();
+                count = classifier.compact(source.data(), source.size(), tokens.data());
+                chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+                double speed = source.size() / elapsed.count() / (1024 * 1024);
+                fastest = max(fastest, speed);
+            }
+            if(level == Classifier::SCALAR) {
+                expectedTokens.assign(tokens.begin(), tokens.begin() + count);
+            } else if(!equal(expectedTokens.begin(), expectedTokens.end(), tokens.begin()) ||
+                      count != expectedTokens.size()) {
+                cerr << "Error: " << Classifier::name(classifier.level())
+                     << " doesn't match the scalar classifier" << endl;
+                return 1;
+            }
+            cout << setw(7) << density << "%  " << left << setw(7) << Classifier::name(classifier.level())
+                 << right << setw(7) << (long)fastest << endl;
+        }
+    }
+    return 0;
+}
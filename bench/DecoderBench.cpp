@@ -0,0 +1,179 @@
+// Compares the table-driven decoder of the Parser with the nested if/else
+// decoder it replaced, on a large generated program without comments.
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+
+#include "../Parser.h"
+
+using namespace std;
+
+static const unsigned INSTRUCTIONS = 4 * 1024 * 1024;
+static const int ROUNDS = 5;
+
+static void appendBits(string &source, unsigned long value, int bits) {
+    for(int k = bits - 1; k >= 0; k--) {
+        source.push_back((value >> k) & 1 ? '\t' : ' ');
+    }
+    source.push_back('\n');
+}
+
+// Random instructions, weighted like real programs towards PUSH and flow control
+static string makeSource() {
+    static const char *codes[] = {
+        "  ", " \n ", " \t ", " \n\t", " \n\n", " \t\n",
+        "\t   ", "\t  \t", "\t  \n", "\t \t ", "\t \t\t", "\t\t ", "\t\t\t",
+        "\n  ", "\n \t", "\n \n", "\n\t ", "\n\t\t", "\n\t\n", "\n\n\n",
+        "\t\n  ", "\t\n \t", "\t\n\t ", "\t\n\t\t"
+    };
+    mt19937 random(42);
+    uniform_int_distribution<int> pick(0, 2 * 24 - 1), bits(1, 16);
+    string source;
+
+    for(unsigned k = 0; k < INSTRUCTIONS; k++) {
+        int code = pick(random) % 24;
+        source.append(codes[code]);
+        if(code == 0 || code == 2 || code == 5) { // PUSH, COPY, SLIDE
+            source.push_back(' ');
+            appendBits(source, random(), bits(random));
+        } else if(code >= 13 && code <= 17) { // Labels
+            appendBits(source, random(), bits(random));
+        }
+    }
+    return source;
+}
+
+// The decoder before the table, reduced to what the benchmark needs. It
+// builds the same Program, but only supports numbers that fit in a word.
+class NestedDecoder {
+    public:
+        Program decode(const vector<unsigned char> &tokens) {
+            Program p;
+            size_t k = 0;
+            while(k < tokens.size()) {
+                argument = 0;
+                Opcode op = decodeOne(tokens, k);
+                p.push_back(Instruction(op, argument));
+            }
+            return p;
+        }
+
+    private:
+        long argument;
+
+        // Numbers and labels are both short here, so a machine word will do
+        void skipArgument(const vector<unsigned char> &tokens, size_t &k, bool number = false) {
+            unsigned char sign = (number ? tokens[k++] : (unsigned char)SPACE);
+            long value = (number ? 0 : 1);
+            for(unsigned char t = tokens[k++]; t != LINEFEED; t = tokens[k++]) {
+                value = (value << 1) | (t == TAB ? 1 : 0);
+            }
+            argument = (sign == TAB ? -value : value);
+        }
+
+        Opcode decodeOne(const vector<unsigned char> &tokens, size_t &k) {
+            unsigned char t = tokens[k++];
+            if(t == SPACE) {
+                t = tokens[k++];
+                if(t == SPACE) {
+                    skipArgument(tokens, k, true);
+                    return PUSH;
+                } else if(t == TAB) {
+                    t = tokens[k++];
+                    skipArgument(tokens, k, true);
+                    if(t == SPACE) {
+                        return COPY;
+                    } else if(t == LINEFEED) {
+                        return SLIDE;
+                    }
+                    throw UnreachableTokenException();
+                }
+                t = tokens[k++];
+                return (t == SPACE ? DUP : t == TAB ? SWAP : DISCARD);
+            } else if(t == LINEFEED) {
+                unsigned char u = tokens[k++];
+                t = tokens[k++];
+                if(u == SPACE) {
+                    skipArgument(tokens, k);
+                    return (t == SPACE ? MARK : t == TAB ? CALL : JUMP);
+                } else if(u == TAB) {
+                    if(t == LINEFEED) {
+                        return ENDSUB;
+                    }
+                    skipArgument(tokens, k);
+                    return (t == SPACE ? JUMPZERO : JUMPNEG);
+                } else if(t == LINEFEED) {
+                    return ENDPROG;
+                }
+                throw UnreachableTokenException();
+            }
+            t = tokens[k++];
+            if(t == SPACE) {
+                unsigned char u = tokens[k++];
+                t = tokens[k++];
+                if(u == SPACE) {
+                    return (t == SPACE ? ADD : t == TAB ? SUB : MUL);
+                } else if(u == TAB && t != LINEFEED) {
+                    return (t == SPACE ? DIV : MOD);
+                }
+            } else if(t == TAB) {
+                t = tokens[k++];
+                if(t != LINEFEED) {
+                    return (t == SPACE ? STORE : RETRIEVE);
+                }
+            } else {
+                unsigned char u = tokens[k++];
+                t = tokens[k++];
+                if(u != LINEFEED && t != LINEFEED) {
+                    return (u == SPACE ? (t == SPACE ? WRITEC : WRITEN) : (t == SPACE ? READC : READN));
+                }
+            }
+            throw UnreachableTokenException();
+        }
+};
+
+int main() {
+    string source = makeSource();
+    Classifier classifier;
+    Parser parser;
+    NestedDecoder nested;
+    double tableTime = 1e9, nestedTime = 1e9;
+    Program program;
+    Program reference;
+
+    for(int round = 0; round < ROUNDS; round++) {
+        auto start = chrono::steady_clock::now();
+        program = parser.parse(source.data(), source.size());
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        tableTime = min(tableTime, elapsed.count());
+
+        // Classified the same way, so only the decoding differs
+        start = chrono::steady_clock::now();
+        vector<unsigned char> tokens(source.size());
+        tokens.resize(classifier.compact(source.data(), source.size(), tokens.data()));
+        reference = nested.decode(tokens);
+        elapsed = chrono::steady_clock::now() - start;
+        nestedTime = min(nestedTime, elapsed.count());
+    }
+
+    if(reference.size() != program.size()) {
+        cerr << "Error: the decoders found a different number of instructions" << endl;
+        return 1;
+    }
+    for(size_t k = 0; k < reference.size(); k++) {
+        if(reference[k].op != program[k].op || reference[k].arg.toLong() != program[k].arg.toLong()) {
+            cerr << "Error: the decoders disagree at instruction " << k << endl;
+            return 1;
+        }
+    }
+
+    double megabytes = source.size() / (1024.0 * 1024.0);
+    cout << program.size() << " instructions, " << (long)megabytes << " MB of source" << endl;
+    cout << "table:  " << (long)(megabytes / tableTime) << " MB/s, "
+         << (long)(program.size() / tableTime / 1e6) << "M instructions/s" << endl;
+    cout << "nested: " << (long)(megabytes / nestedTime) << " MB/s, "
+         << (long)(program.size() / nestedTime / 1e6) << "M instructions/s" << endl;
+    return 0;
+}
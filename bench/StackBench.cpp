@@ -0,0 +1,124 @@
+// Compares the engines on loops made of ADD, SUB, MUL, DUP and SWAP, the
+// instructions the cached engine keeps out of memory. The programs are
+// built as instructions directly, without the optimizer.
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "../Interpreter.h"
+#include "../Linker.h"
+
+using namespace std;
+
+static const long ITERATIONS = 10 * 1000 * 1000;
+static const int ROUNDS = 7;
+
+enum { LOOP = 1, END = 2 };
+
+// Wraps a loop body around a counter. The body starts and ends with the
+// stack as [accumulator, counter]; the accumulator is printed at the end.
+static Program makeLoop(long accumulator, const vector<Instruction> &body) {
+    Program p;
+    p.push_back(Instruction(PUSH, accumulator));
+    p.push_back(Instruction(PUSH, ITERATIONS));
+    p.push_back(Instruction(MARK, LOOP));
+    p.insert(p.end(), body.begin(), body.end());
+    p.push_back(Instruction(PUSH, 1));
+    p.push_back(Instruction(SUB));
+    p.push_back(Instruction(DUP));
+    p.push_back(Instruction(JUMPZERO, END));
+    p.push_back(Instruction(JUMP, LOOP));
+    p.push_back(Instruction(MARK, END));
+    p.push_back(Instruction(DISCARD));
+    p.push_back(Instruction(WRITEN));
+    p.push_back(Instruction(ENDPROG));
+    Linker linker;
+    linker.link(p);
+    return p;
+}
+
+struct Kernel {
+    const char *name;
+    Program program;
+};
+
+static vector<Kernel> makeKernels() {
+    vector<Kernel> kernels;
+
+    // acc = acc + 3 - 2
+    kernels.push_back(Kernel{"add-sub", makeLoop(0, {
+        Instruction(SWAP), Instruction(PUSH, 3), Instruction(ADD), Instruction(PUSH, 2), Instruction(SUB), Instruction(SWAP)
+    })});
+
+    // acc = acc * acc mod 1000003
+    kernels.push_back(Kernel{"dup-mul", makeLoop(2, {
+        Instruction(SWAP), Instruction(DUP), Instruction(MUL), Instruction(PUSH, 1000003), Instruction(MOD), Instruction(SWAP)
+    })});
+
+    // acc = ((acc + counter) * 3 - acc) mod 65535, shuffling with DUP and SWAP
+    kernels.push_back(Kernel{"dup-swap", makeLoop(1, {
+        Instruction(SWAP), Instruction(DUP), Instruction(COPY, 2), Instruction(ADD), Instruction(PUSH, 3),
+        Instruction(MUL), Instruction(SWAP), Instruction(SUB), Instruction(PUSH, 65535), Instruction(MOD),
+        Instruction(SWAP), Instruction(DUP), Instruction(SWAP), Instruction(DISCARD)
+    })});
+    return kernels;
+}
+
+struct Result {
+    double fastest;
+    unsigned long long count;
+    string output;
+};
+
+static void run(const Program &program, Engine engine, Result &result) {
+    BufferSource input("");
+    BufferSink sink;
+    {
+        Interpreter interpreter(program);
+        interpreter.redirect(input, sink);
+        auto start = chrono::steady_clock::now();
+        interpreter.interpret(engine);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        result.fastest = min(result.fastest, elapsed.count());
+        result.count = interpreter.instructionCount();
+    }
+    result.output = sink.contents();
+}
+
+int main() {
+    static const pair<Engine, const char *> engines[] = {
+        {SWITCH_ENGINE, "switch"}, {THREADED_ENGINE, "threaded"}, {CACHED_ENGINE, "cached"}
+    };
+    static const int ENGINE_COUNT = sizeof(engines) / sizeof(engines[0]);
+
+    cout << left << setw(10) << "kernel" << setw(10) << "engine" << right << setw(12) << "Mi/s"
+         << setw(12) << "output" << endl;
+    for(Kernel &kernel : makeKernels()) {
+        // The engines take turns, so a noisy moment doesn't favour one of them
+        Result results[ENGINE_COUNT];
+        for(Result &result : results) {
+            result.fastest = 1e9;
+        }
+        for(int round = 0; round < ROUNDS; round++) {
+            for(int k = 0; k < ENGINE_COUNT; k++) {
+                run(kernel.program, engines[k].first, results[k]);
+            }
+        }
+
+        double threaded = 0;
+        for(int k = 0; k < ENGINE_COUNT; k++) {
+            double rate = results[k].count / results[k].fastest / 1e6;
+            cout << left << setw(10) << kernel.name << setw(10) << engines[k].second << right << fixed
+                 << setprecision(1) << setw(12) << rate << setw(12) << results[k].output;
+            if(engines[k].first == THREADED_ENGINE) {
+                threaded = rate;
+            } else if(engines[k].first == CACHED_ENGINE && threaded > 0) {
+                cout << "  " << showpos << (rate / threaded - 1) * 100 << noshowpos << "% vs threaded";
+            }
+            cout << endl;
+        }
+    }
+    return 0;
+}
@@ -1,8 +1,19 @@
 #include <cstdlib>
 #include <cctype>
-#include <fstream>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <memory>
 
 #include "Parser.h"
+#include "SourceFile.h"
+#include "BytecodeCache.h"
+#include "Optimizer.h"
+#include "Linker.h"
+#include "CEmitter.h"
+#include "BatchRunner.h"
+#include "Checkpoint.h"
+#include "Server.h"
 #include "Exceptions.h"
 
 using namespace std;
@@ -43,8 +54,7 @@ Program stringToProgram(string program) {
 	  if(k >= size) throw SomeException();
 	}	
 	long number = atoi(d.c_str());
-	p.push_back(PUSH);
-	p.push_back(number);
+	p.push_back(Instruction(PUSH, number));
       } else throw SomeException();
     } else if(program[k] == 'A') {
       if(program.find("ADD", k) == k) {
@@ -56,7 +66,6 @@ Program stringToProgram(string program) {
 	if(program.find("COPY", k) == k) {
 	  p.push_back(COPY);
 	} else if(program.find("CALL", k) == k) {
-	  p.push_back(CALL);
 	  while(program[k++] == ' ' && k < size); // ignore any spaces
 	  if(k >= size || program[k] == '\n') throw SomeException();
 	  string d;
@@ -66,7 +75,7 @@ Program stringToProgram(string program) {
 	    if(k >= size) throw SomeException();
 	  }	
 	  long number = atoi(d.c_str());
-	  p.push_back(number);
+	  p.push_back(Instruction(CALL, number));
 	} else throw SomeException();
       } else throw SomeException();
     } else if(program[k] == 'D') {
@@ -92,6 +101,7 @@ Program stringToProgram(string program) {
     while(k < size && program[k++] == ' ');
     if(k >= size || program[++k] != '\n') throw SomeException(); // there should be a newline here
   }
+  return p;
 }
 
 string programToString(Program p) {
@@ -99,7 +109,7 @@ string programToString(Program p) {
     string s;
 
     for(int k = 0; k < size; k++) {
-        switch(p[k]) {
+        switch(p[k].op) {
             case PUSH: s.append("PUSH "); break;
             case DUP: s.append("DUP"); break;
             case COPY: s.append("COPY "); break;
@@ -115,11 +125,11 @@ string programToString(Program p) {
             case STORE: s.append("STORE"); break;
             case RETRIEVE: s.append("RETRIEVE"); break;
 
-            case MARK: s.append("MARK"); break;
-            case CALL: s.append("CALL"); break;
-            case JUMP: s.append("JUMP"); break;
-            case JUMPZERO: s.append("JUMPZERO"); break;
-            case JUMPNEG: s.append("JUMPNEG"); break;
+            case MARK: s.append("MARK "); break;
+            case CALL: s.append("CALL "); break;
+            case JUMP: s.append("JUMP "); break;
+            case JUMPZERO: s.append("JUMPZERO "); break;
+            case JUMPNEG: s.append("JUMPNEG "); break;
             case ENDSUB: s.append("ENDSUB"); break;
             case ENDPROG: s.append("ENDPROG"); break;
 
@@ -127,50 +137,297 @@ string programToString(Program p) {
             case WRITEN: s.append("WRITEN"); break;
             case READC: s.append("READC"); break;
             case READN: s.append("READN"); break;
+
+            case PUSHADD: s.append("PUSHADD "); break;
+            case PUSHSUB: s.append("PUSHSUB "); break;
+            case PUSHMUL: s.append("PUSHMUL "); break;
+            case PUSHRETRIEVE: s.append("PUSHRETRIEVE "); break;
+            case PUSHSTORE: s.append("PUSHSTORE "); break;
+            case PUSHWRITEC: s.append("PUSHWRITEC "); break;
+            case DUPJUMPZERO: s.append("DUPJUMPZERO "); break;
+            case DUPJUMPNEG: s.append("DUPJUMPNEG "); break;
+            case WRITESTRING: s.append("WRITESTRING "); break;
+            case FILLHEAP: s.append("FILLHEAP "); break;
+            case COPYHEAP: s.append("COPYHEAP "); break;
             default: throw InstructionNotFoundException();
         }
-        switch(p[k]) {
-		    case PUSH: case COPY: case SLIDE: case MARK:
-		    case CALL: case JUMP: case JUMPZERO: case JUMPNEG:
-		        s.append(to_string(p[++k])); break;
-		    default: break;
+        if(hasArgument(p[k].op)) {
+            s.append(p[k].arg.toString());
         }
         s.append("\n");
     }
     return s;
 }
 
-const string readFile(const string filename) {
-    string line, fileContents;
-    ifstream input;
+// Decodes, optimizes and links a program from its source
+Program compileProgram(const char *data, size_t size, bool optimize, bool dump) {
+    // Decode the source in a single pass.
+    Parser parser;
+    Program program = parser.parse(data, size);
 
-    input.open(filename.c_str());
-    if (input.is_open()) {
-        while (!input.eof()) {
-            getline(input, line);
-            fileContents.append(line);
-            fileContents.append("\n");
+    // Print the tokens in an assembly-like way.
+    if(dump) {
+        printTokens(parser.tokenize(data, size));
+        cout << endl;
+    }
+
+    // Fold constants, fuse common instruction sequences and remove dead
+    // code before the labels are resolved.
+    if(optimize) {
+        Optimizer optimizer;
+        program = optimizer.optimize(program);
+        if(dump) {
+            cout << "; " << optimizer.fusedCount() << " superinstructions, "
+                 << optimizer.foldedCount() << " constants folded, "
+                 << optimizer.threadedCount() << " jumps threaded, "
+                 << optimizer.idiomCount() << " loop idioms, "
+                 << optimizer.removedCount() << " instructions removed" << endl;
         }
     }
-    return fileContents;
+    if(dump) {
+        cout << programToString(program) << endl;
+    }
+
+    // Resolve all labels before running, so jumps are direct indices.
+    Linker linker;
+    linker.link(program);
+    return program;
 }
 
-int main() {
-    // Load the Whitespace source file and tokenize it.
-    Parser parser;
-    string fileContents = readFile("hello_worldvanwiki.ws");
-    auto tokens = parser.tokenize(fileContents);
-    printTokens(tokens);
-    cout << endl;
+// Compiles a program, or loads it from the cache
+Program loadProgram(const string &filename, bool optimize, bool useCache, bool dump) {
+    // Map the Whitespace source file. A cached program saves decoding it,
+    // as long as the source hasn't changed since.
+    SourceFile source(filename);
+    BytecodeCache cache(filename);
+    uint64_t sourceHash = (useCache ? BytecodeCache::hash(source.data(), source.size()) : 0);
+    Program program;
 
-    // Print the tokens in an assembly-like way.
-    auto program = parser.tokensToProgram(tokens);
-    string textrep = programToString(program);
-    cout << textrep << endl;
+    if(!useCache || dump || !cache.load(sourceHash, optimize, program)) {
+        program = compileProgram(source.data(), source.size(), optimize, dump);
+        if(useCache) {
+            cache.save(sourceHash, optimize, program);
+        }
+    }
+    return program;
+}
+
+static const unsigned long long CHECKPOINT_SLICE = 1 << 20; // Instructions between signal checks
+static volatile sig_atomic_t checkpointRequested = 0;
+
+void requestCheckpoint(int) {
+    checkpointRequested = 1;
+}
+
+// Runs the program a slice at a time, continuing from the last checkpoint
+// if there is one. A checkpoint is taken every so many instructions and on
+// SIGUSR1, and removed once the program has ended.
+void runWithCheckpoints(Interpreter &interpreter, Checkpoint &checkpoint, unsigned long long every) {
+    if(checkpoint.restore(interpreter)) {
+        cerr << "Resuming after " << interpreter.instructionCount() << " instructions" << endl;
+        if(!checkpoint.outputRewound()) {
+            cerr << "Warning: output written after the checkpoint could not be dropped" << endl;
+        }
+    }
+    signal(SIGUSR1, requestCheckpoint);
+
+    unsigned long long next = interpreter.instructionCount() + every;
+    Status status;
+    while((status = interpreter.run(min(every, CHECKPOINT_SLICE))) != FINISHED && status != FAILED) {
+        if(checkpointRequested || interpreter.instructionCount() >= next) {
+            checkpointRequested = 0;
+            if(!checkpoint.save(interpreter)) {
+                cerr << "Warning: the checkpoint could not be written" << endl;
+            }
+            next = interpreter.instructionCount() + every;
+        }
+    }
+    if(status == FAILED) {
+        rethrow_exception(interpreter.error()); // The checkpoint is kept
+    }
+    checkpoint.remove();
+}
+
+void printUsage(const char *name) {
+    cerr << "Usage: " << name << " [options] [file]" << endl
+         << "Options:" << endl
+         << "  --engine=switch    dispatch with a switch statement (default)" << endl
+         << "  --engine=threaded  dispatch with direct-threaded code" << endl
+         << "  --engine=cached    direct-threaded code, the top of the stack in registers" << endl
+         << "  --engine=jit       compile to native x86-64 code" << endl
+         << "  --optimize         fold constants, fuse superinstructions, thread jumps," << endl
+         << "                     remove dead code and run loop idioms at once" << endl
+         << "  --dump             print the tokens and the (optimized) program before running" << endl
+         << "  --heap-limit=MB    maximum heap size in megabytes (default 1024)" << endl
+         << "  --stats            print executed instructions per second" << endl
+         << "  --profile          print instruction counts and time per subroutine at exit" << endl
+         << "  --memoize          remember the results of pure subroutines (switch engine)" << endl
+         << "  --emit-c           print the program as C source instead of running it" << endl
+         << "  --no-cache         don't read or write the bytecode cache (file.wsc)" << endl
+         << "  --batch=LIST       run the jobs in LIST, one 'source [input [output]]' per line" << endl
+         << "  --threads=N        threads for --batch and --serve (default: one per core)" << endl
+         << "  --checkpoint=FILE  save the state to FILE now and then, and resume from it" << endl
+         << "  --checkpoint-every=N  instructions between checkpoints (default 100000000)" << endl
+         << "  --serve=SOCKET     keep running and run programs for clients of the Unix socket" << endl
+         << "  --cache-size=N     programs --serve keeps compiled (default 64)" << endl
+         << "  --connect=SOCKET   run the program on the server behind SOCKET" << endl;
+}
+
+int run(int argc, char *argv[]) {
+    string filename = "hello_worldvanwiki.ws";
+    Engine engine = SWITCH_ENGINE;
+    size_t heapLimit = Heap::DEFAULT_LIMIT;
+    bool optimize = false, dump = false, stats = false, emitC = false, useCache = true, profile = false;
+    bool memoize = false;
+    string batch;
+    unsigned threads = thread::hardware_concurrency();
+    string checkpointFile;
+    unsigned long long checkpointEvery = 100000000;
+    string serveSocket, connectSocket;
+    size_t cacheSize = 64;
+
+    for(int k = 1; k < argc; k++) {
+        string arg = argv[k];
+        if(arg == "--engine=switch") {
+            engine = SWITCH_ENGINE;
+        } else if(arg == "--engine=threaded") {
+            engine = THREADED_ENGINE;
+        } else if(arg == "--engine=cached") {
+            engine = CACHED_ENGINE;
+        } else if(arg == "--engine=jit") {
+            engine = JIT_ENGINE;
+        } else if(arg == "--optimize") {
+            optimize = true;
+        } else if(arg == "--dump") {
+            dump = true;
+        } else if(arg.compare(0, 13, "--heap-limit=") == 0) {
+            heapLimit = strtoul(arg.c_str() + 13, NULL, 10) * 1024 * 1024;
+        } else if(arg == "--stats") {
+            stats = true;
+        } else if(arg == "--profile") {
+            profile = true;
+        } else if(arg == "--memoize") {
+            memoize = true;
+        } else if(arg == "--emit-c") {
+            emitC = true;
+        } else if(arg == "--no-cache") {
+            useCache = false;
+        } else if(arg.compare(0, 8, "--batch=") == 0) {
+            batch = arg.substr(8);
+        } else if(arg.compare(0, 10, "--threads=") == 0) {
+            threads = strtoul(arg.c_str() + 10, NULL, 10);
+        } else if(arg.compare(0, 13, "--checkpoint=") == 0) {
+            checkpointFile = arg.substr(13);
+        } else if(arg.compare(0, 19, "--checkpoint-every=") == 0) {
+            checkpointEvery = max(1ULL, strtoull(arg.c_str() + 19, NULL, 10));
+        } else if(arg.compare(0, 8, "--serve=") == 0) {
+            serveSocket = arg.substr(8);
+        } else if(arg.compare(0, 13, "--cache-size=") == 0) {
+            cacheSize = strtoul(arg.c_str() + 13, NULL, 10);
+        } else if(arg.compare(0, 10, "--connect=") == 0) {
+            connectSocket = arg.substr(10);
+        } else if(arg.compare(0, 2, "--") == 0) {
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            filename = arg;
+        }
+    }
+
+    // Run every program of a list on all cores instead of a single one.
+    if(!batch.empty()) {
+        BatchRunner runner([=](const string &source) {
+            return loadProgram(source, optimize, useCache, false);
+        }, engine, heapLimit, threads);
+        return (runner.run(BatchRunner::readList(batch), cout, cerr) ? 0 : 1);
+    }
+
+    // Keep compiled programs in memory for the clients of a socket.
+    if(!serveSocket.empty()) {
+        Server server(serveSocket, [=](const char *data, size_t size) {
+            return compileProgram(data, size, optimize, false);
+        }, engine, heapLimit, threads, cacheSize);
+        server.run();
+    }
+    if(!connectSocket.empty()) {
+        return Server::request(connectSocket, filename);
+    }
+
+    Program program = loadProgram(filename, optimize, useCache, dump);
+
+    // Translate to C instead of running, to be compiled with WhitespaceRuntime.h.
+    if(emitC) {
+        CEmitter emitter;
+        cout << emitter.emit(program);
+        return 0;
+    }
 
     // Interpret the Whitespace source file.
-    Interpreter interpreter(program);
-    interpreter.interpret();
+    // Profiling needs the program afterwards to annotate the report.
+    Profiler profiler(program.size());
+    Program profiled;
+    if(profile) {
+        profiled = program;
+    }
+    // Pure subroutines are found in the linked program.
+    unique_ptr<Memoizer> memoizer;
+    if(memoize) {
+        memoizer.reset(new Memoizer(program));
+    }
+    Interpreter interpreter(move(program), ValueStack::DEFAULT_CAPACITY, heapLimit);
+    if(profile) {
+        interpreter.profile(&profiler);
+    }
+    if(memoize) {
+        interpreter.memoize(memoizer.get());
+    }
+    cout.flush(); // The interpreter writes to standard output itself
+    auto start = chrono::steady_clock::now();
+    try {
+        if(!checkpointFile.empty()) { // Checkpoints are taken between slices of the switch engine
+            SourceFile source(filename);
+            Checkpoint checkpoint(checkpointFile, BytecodeCache::hash(source.data(), source.size()), optimize);
+            runWithCheckpoints(interpreter, checkpoint, checkpointEvery);
+        } else {
+            interpreter.interpret(engine);
+        }
+    } catch(...) {
+        if(profile) { // The profile tells where it went wrong
+            profiler.finish();
+            profiler.report(cerr, profiled, programToString(profiled));
+        }
+        throw;
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    if(profile) {
+        profiler.report(cerr, profiled, programToString(profiled));
+    }
+
+    if(stats) {
+        unsigned long long count = interpreter.instructionCount();
+        if(count > 0) { // Native code doesn't count its instructions
+            cerr << count << " instructions in " << elapsed.count() << " s ("
+                 << (elapsed.count() > 0 ? count / elapsed.count() : 0) << " instructions/s)" << endl;
+        } else {
+            cerr << "Ran in " << elapsed.count() << " s" << endl;
+        }
+        if(memoize) {
+            cerr << memoizer->pureCount() << " pure subroutines, " << memoizer->hitCount() << " hits, "
+                 << memoizer->missCount() << " misses" << endl;
+        }
+    }
 
     return 0;
 }
+
+// Errors end up here as a message instead of aborting the process
+int main(int argc, char *argv[]) {
+    try {
+        return run(argc, argv);
+    } catch(exception &e) {
+        cout.flush();
+        cerr << e.what() << endl;
+        return 1;
+    }
+}